@@ -0,0 +1,80 @@
+/*
+ * Measures how much the per tag set cache of view dimensions saves at high
+ * view counts. For each view count, layout demands are timed
+ *
+ *   full:    with the cache cleared before each demand, so all areas are
+ *            arranged again,
+ *   repeat:  with the same parameters as the previous demand, so all areas
+ *            are reused,
+ *   tags:    alternating between two tag sets, each of which keeps its own
+ *            cache entry,
+ *   +-1:     alternating between the view count and one more, as when a
+ *            view is opened and closed again.
+ *
+ * Only areas with the same dimensions and amount of views as in the previous
+ * demand are reused. The last area takes all remaining views, so a changed
+ * view count arranges it again and "+-1" costs about as much as "full".
+ *
+ * Times include pushing the views to the mock compositor.
+ */
+
+#define main stacktile_main
+#include "../stacktile.c"
+#undef main
+
+#include "../test/mock-wayland.h"
+
+/* Amount of views laid out per measurement, spread over the demands. */
+#define VIEWS_PER_RUN 20000000
+
+static const uint32_t view_counts[] = { 10, 100, 1000, 10000, 50000 };
+
+static void clear_cache (struct Layout *layout)
+{
+	for (size_t i = 0; i < LAYOUT_CACHE_SIZE; i++)
+		layout->cache[i].generation = 0;
+}
+
+/** Returns the average time of a layout demand in nanoseconds. */
+static double run (struct Layout *layout, uint32_t view_count, bool clear, bool alternate_tags,
+		bool alternate_count)
+{
+	const uint32_t demands = MAX(VIEWS_PER_RUN / view_count, 10);
+	const uint64_t start = get_time();
+	for (uint32_t i = 0; i < demands; i++)
+	{
+		if (clear)
+			clear_cache(layout);
+		mock_layout_demand(layout->river_layout, alternate_count ? view_count + i % 2 : view_count,
+				3840, 2160, alternate_tags ? 1u << (i % 2) : 1, i);
+	}
+	return (double)(get_time() - start) / demands;
+}
+
+int main (void)
+{
+	init_layout_configs();
+	wl_list_init(&outputs);
+	layout_manager = (struct river_layout_manager_v3 *)mock_proxy_create(
+			&river_layout_manager_v3_interface);
+	if (! create_output((struct wl_output *)mock_proxy_create(&wl_output_interface), 1))
+		return EXIT_FAILURE;
+	struct Output *output = wl_container_of(outputs.next, output, link);
+	struct Layout *layout = &output->layouts[0];
+
+	printf("layout \"%s\", 3840x2160\n", namespaces[0].default_layout_config.name);
+	printf("%8s %14s %14s %14s %14s\n", "views", "full (us)", "repeat (us)", "tags (us)",
+			"+-1 (us)");
+	for (size_t i = 0; i < sizeof(view_counts) / sizeof(view_counts[0]); i++)
+	{
+		const uint32_t count = view_counts[i];
+		mock_layout_demand(layout->river_layout, count, 3840, 2160, 1, 0);
+		const double full   = run(layout, count, true, false, false);
+		const double repeat = run(layout, count, false, false, false);
+		const double tags   = run(layout, count, false, true, false);
+		const double grow   = run(layout, count, false, false, true);
+		printf("%8u %14.3f %14.3f %14.3f %14.3f\n", count, full / 1000.0, repeat / 1000.0,
+				tags / 1000.0, grow / 1000.0);
+	}
+	return EXIT_SUCCESS;
+}
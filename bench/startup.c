@@ -0,0 +1,285 @@
+/*
+ * Measures the time from starting stacktile to its first layout commit on
+ * every output. A minimal compositor is run on a new socket for each run. It
+ * announces OUTPUT_COUNT outputs and the layout manager, sends a layout demand
+ * as soon as a layout is created and stops the clock once every output got a
+ * commit. The clock starts right before stacktile is forked and executed.
+ *
+ * Both orders of announcing the globals are measured, as stacktile can only
+ * request the layouts of outputs announced before the layout manager once it
+ * knows the manager.
+ *
+ * Usage: bench/startup [path of stacktile [runs]]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <wayland-server.h>
+
+#include "../river-layout-v3-server.h"
+
+#define OUTPUT_COUNT 3
+#define DEFAULT_RUNS 20
+
+/* Upper bound on the time of a single run, in nanoseconds. */
+#define TIMEOUT 5000000000
+
+struct Mock_output
+{
+	uint32_t index;
+	bool committed;
+};
+
+/* State of the current run. */
+static struct
+{
+	struct wl_display *display;
+	struct Mock_output outputs[OUTPUT_COUNT];
+	uint32_t committed;
+	uint32_t serial;
+} run;
+
+static uint64_t get_time (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void destroy_resource (struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void layout_push_view_dimensions (struct wl_client *client, struct wl_resource *resource,
+		int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t serial)
+{
+}
+
+static void layout_commit (struct wl_client *client, struct wl_resource *resource,
+		const char *layout_name, uint32_t serial)
+{
+	struct Mock_output *output = wl_resource_get_user_data(resource);
+	if ( output == NULL || output->committed )
+		return;
+	output->committed = true;
+	run.committed++;
+}
+
+static const struct river_layout_v3_interface layout_implementation = {
+	.destroy              = destroy_resource,
+	.push_view_dimensions = layout_push_view_dimensions,
+	.commit               = layout_commit,
+};
+
+static void layout_manager_get_layout (struct wl_client *client, struct wl_resource *resource,
+		uint32_t id, struct wl_resource *output_resource, const char *namespace)
+{
+	struct wl_resource *layout = wl_resource_create(client, &river_layout_v3_interface,
+			wl_resource_get_version(resource), id);
+	if ( layout == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	struct Mock_output *output = wl_resource_get_user_data(output_resource);
+	wl_resource_set_implementation(layout, &layout_implementation, output, NULL);
+
+	/* Like river with windows waiting for a layout, the first layout is
+	 * demanded right away.
+	 */
+	river_layout_v3_send_layout_demand(layout, 3, 1920, 1080, 1, ++run.serial);
+}
+
+static const struct river_layout_manager_v3_interface layout_manager_implementation = {
+	.destroy    = destroy_resource,
+	.get_layout = layout_manager_get_layout,
+};
+
+static void bind_layout_manager (struct wl_client *client, void *data, uint32_t version,
+		uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client,
+			&river_layout_manager_v3_interface, (int)version, id);
+	if ( resource == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &layout_manager_implementation, NULL, NULL);
+}
+
+static const struct wl_output_interface output_implementation = {
+	.release = destroy_resource,
+};
+
+static void bind_output (struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+	struct Mock_output *output = data;
+	struct wl_resource *resource = wl_resource_create(client, &wl_output_interface,
+			(int)version, id);
+	if ( resource == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &output_implementation, output, NULL);
+
+	wl_output_send_geometry(resource, 1920 * (int32_t)output->index, 0, 600, 340,
+			WL_OUTPUT_SUBPIXEL_UNKNOWN, "mock", "mock", WL_OUTPUT_TRANSFORM_NORMAL);
+	wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT, 1920, 1080, 60000);
+	if ( version >= WL_OUTPUT_NAME_SINCE_VERSION )
+	{
+		char name[16];
+		snprintf(name, sizeof(name), "MOCK-%u", output->index + 1);
+		wl_output_send_name(resource, name);
+	}
+	if ( version >= WL_OUTPUT_DONE_SINCE_VERSION )
+		wl_output_send_done(resource);
+}
+
+static void create_globals (bool manager_first)
+{
+	if (manager_first)
+		wl_global_create(run.display, &river_layout_manager_v3_interface, 1, NULL,
+				bind_layout_manager);
+	for (uint32_t i = 0; i < OUTPUT_COUNT; i++)
+	{
+		run.outputs[i].index = i;
+		wl_global_create(run.display, &wl_output_interface, 4, &run.outputs[i], bind_output);
+	}
+	if (! manager_first)
+		wl_global_create(run.display, &river_layout_manager_v3_interface, 1, NULL,
+				bind_layout_manager);
+}
+
+/**
+ * Starts stacktile on a new compositor and returns the time until it
+ * committed a layout on every output, or 0 if it did not.
+ */
+static uint64_t run_once (const char *path, bool manager_first)
+{
+	memset(&run, 0, sizeof(run));
+	run.display = wl_display_create();
+	if ( run.display == NULL )
+	{
+		fputs("ERROR: Failed to create the display.\n", stderr);
+		return 0;
+	}
+	const char *socket = wl_display_add_socket_auto(run.display);
+	if ( socket == NULL )
+	{
+		fputs("ERROR: Failed to add a socket.\n", stderr);
+		wl_display_destroy(run.display);
+		return 0;
+	}
+	create_globals(manager_first);
+
+	const uint64_t start = get_time();
+	const pid_t pid = fork();
+	if ( pid == -1 )
+	{
+		perror("fork");
+		wl_display_destroy(run.display);
+		return 0;
+	}
+	if ( pid == 0 )
+	{
+		setenv("WAYLAND_DISPLAY", socket, 1);
+		execl(path, path, (char *)NULL);
+		perror(path);
+		_exit(127);
+	}
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(run.display);
+	uint64_t duration = 0;
+	while ( get_time() - start < TIMEOUT )
+	{
+		wl_display_flush_clients(run.display);
+		wl_event_loop_dispatch(loop, 10);
+		if ( run.committed == OUTPUT_COUNT )
+		{
+			duration = get_time() - start;
+			break;
+		}
+		if ( waitpid(pid, NULL, WNOHANG) == pid )
+		{
+			fputs("ERROR: stacktile exited before committing a layout on every output.\n",
+					stderr);
+			wl_display_destroy(run.display);
+			return 0;
+		}
+	}
+	if ( duration == 0 )
+		fprintf(stderr, "ERROR: %u of %u outputs got a layout within the timeout.\n",
+				run.committed, OUTPUT_COUNT);
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	wl_display_destroy_clients(run.display);
+	wl_display_destroy(run.display);
+	return duration;
+}
+
+static int compare_durations (const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static bool measure (const char *path, uint32_t runs, bool manager_first)
+{
+	uint64_t *durations = calloc(runs, sizeof(uint64_t));
+	if ( durations == NULL )
+	{
+		fputs("Failed to allocate.\n", stderr);
+		return false;
+	}
+	for (uint32_t i = 0; i < runs; i++)
+	{
+		durations[i] = run_once(path, manager_first);
+		if ( durations[i] == 0 )
+		{
+			free(durations);
+			return false;
+		}
+	}
+
+	qsort(durations, runs, sizeof(uint64_t), compare_durations);
+	printf("%-16s %10.3f %10.3f %10.3f\n", manager_first ? "manager first" : "outputs first",
+			(double)durations[0] / 1000000.0, (double)durations[runs / 2] / 1000000.0,
+			(double)durations[runs - 1] / 1000000.0);
+	free(durations);
+	return true;
+}
+
+int main (int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : "./stacktile";
+	const int runs = argc > 2 ? atoi(argv[2]) : DEFAULT_RUNS;
+	if ( runs <= 0 )
+	{
+		fputs("ERROR: The amount of runs must be positive.\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* stacktile is killed at the end of each run, its clients are gone by
+	 * then.
+	 */
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("%s, %d runs, %d outputs, exec to first commit on every output\n",
+			path, runs, OUTPUT_COUNT);
+	printf("%-16s %10s %10s %10s\n", "globals", "min (ms)", "median (ms)", "max (ms)");
+	if ( !measure(path, (uint32_t)runs, false) || !measure(path, (uint32_t)runs, true) )
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
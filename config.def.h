@@ -0,0 +1,56 @@
+/*
+ * Configuration of the fixed build of stacktile, built with
+ * "make stacktile-fixed". Copy this file to config.h and adjust it.
+ *
+ * The fixed build provides a single layout with the values below. It has no
+ * options, does not accept commands and does not support per tag set values,
+ * presets or plugins.
+ */
+
+/* Layout namespace. */
+#define NAMESPACE "stacktile"
+
+/* Padding between views and around the layout. */
+#define INNER_PADDING 10
+#define OUTER_PADDING 10
+
+/* Place all views in the first area which holds views. */
+#define ALL_PRIMARY false
+
+/* Areas of the layout, see --area in stacktile(1). Parents are given as
+ * index, -1 for the usable area of the output. The last area takes all
+ * remaining views.
+ */
+#define AREAS \
+	{ .parent = -1, .count = 1, .ratio = 0.6, .position = LEFT, .sublayout = ROWS  }, \
+	{ .parent = -1, .count = 1, .ratio = 0.6, .position = AUTO, .sublayout = ROWS  }, \
+	{ .parent = -1, .count = 0, .ratio = 0.6, .position = AUTO, .sublayout = STACK },
+
+/* Sublayouts to compile in. All sublayouts used by the areas are needed. */
+#define SUBLAYOUT_COLUMNS 0
+#define SUBLAYOUT_ROWS    1
+#define SUBLAYOUT_STACK   1
+#define SUBLAYOUT_GRID    0
+#define SUBLAYOUT_FULL    0
+
+/* Features to compile in, 1 or 0. Features which are left out cost neither
+ * space nor time.
+ */
+
+/* Export the layout state to STATE_FILE_PATH, see --state-file in
+ * stacktile(1). A relative path is taken relative to $XDG_RUNTIME_DIR.
+ */
+#define STATE_FILE      0
+#define STATE_FILE_PATH "stacktile-state"
+
+/* See --latency-critical in stacktile(1). The policy is SCHED_FIFO, SCHED_RR
+ * or -1 to keep the normal scheduling policy.
+ */
+#define LATENCY_CRITICAL        0
+#define LATENCY_CRITICAL_POLICY -1
+
+/* See --perf-counters in stacktile(1). */
+#define PERF_COUNTERS 0
+
+/* Keep the most recent events, dumped to stderr on SIGUSR2. */
+#define FLIGHT_RECORDER 0
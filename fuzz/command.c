@@ -0,0 +1,117 @@
+/*
+ * Fuzzes user commands. Each line of the input is sent as a command to the
+ * first output, or to the second one if the line starts with '>'. An empty
+ * line is a layout demand on both outputs, which applies the pending changes.
+ * Aborts if a command or layout demand takes longer than TIME_BUDGET.
+ */
+
+#define main stacktile_main
+#include "../stacktile.c"
+#undef main
+
+#include "../test/mock-wayland.h"
+
+/* Upper bound on the time of a single command or layout demand, in
+ * nanoseconds.
+ */
+#define TIME_BUDGET 50000000
+
+#define OUTPUT_COUNT 2
+
+static struct Layout *layouts[OUTPUT_COUNT];
+static uint32_t serial;
+
+static void check_time (uint64_t start, const char *what)
+{
+	const uint64_t duration = get_time() - start;
+	if ( duration <= TIME_BUDGET )
+		return;
+	fprintf(stderr, "FAIL: %s took %.3fms\n", what, (double)duration / 1000000.0);
+	abort();
+}
+
+static void demand (void)
+{
+	serial++;
+	for (size_t i = 0; i < OUTPUT_COUNT; i++)
+	{
+		const uint64_t start = get_time();
+		mock_layout_demand(layouts[i]->river_layout, 1 + serial % 16, 1920, 1080,
+				1u << (serial % 4), serial);
+		check_time(start, "layout demand");
+	}
+}
+
+static void command (struct Layout *layout, const char *command)
+{
+	/* Plugins are arbitrary code, loading them is not fuzzed. */
+	if ( strstr(command, "load_plugin") != NULL )
+		return;
+
+	const uint64_t start = get_time();
+	mock_user_command(layout->river_layout, command);
+	check_time(start, command);
+}
+
+/** Returns to the state after LLVMFuzzerInitialize(), so inputs do not interfere. */
+static void reset (void)
+{
+	handle_user_command(layouts[0], "all reset");
+	memset(presets, 0, sizeof(presets));
+	preset_count = 0;
+}
+
+int LLVMFuzzerInitialize (int *argc, char ***argv)
+{
+	default_namespace.per_tag_config = true;
+	init_layout_configs();
+	wl_list_init(&outputs);
+	layout_manager = (struct river_layout_manager_v3 *)mock_proxy_create(
+			&river_layout_manager_v3_interface);
+	for (uint32_t i = 0; i < OUTPUT_COUNT; i++)
+		if (! create_output((struct wl_output *)mock_proxy_create(&wl_output_interface), i + 1))
+			abort();
+
+	size_t i = OUTPUT_COUNT;
+	struct Output *output;
+	wl_list_for_each(output, &outputs, link)
+		layouts[--i] = &output->layouts[0];
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+	/* Commands are strings, so the input is split into lines and each is
+	 * terminated. Longer lines than river sends are still tried, to test
+	 * the bounds on commands.
+	 */
+	char *buffer = malloc(size + 1);
+	if ( buffer == NULL )
+		abort();
+	memcpy(buffer, data, size);
+	buffer[size] = '\0';
+
+	char *line = buffer;
+	while ( line < buffer + size )
+	{
+		char *end = memchr(line, '\n', (size_t)(buffer + size - line));
+		if ( end != NULL )
+			*end = '\0';
+
+		if ( *line == '\0' )
+			demand();
+		else if ( *line == '>' )
+			command(layouts[1], line + 1);
+		else
+			command(layouts[0], line);
+
+		if ( end == NULL )
+			break;
+		line = end + 1;
+	}
+	demand();
+
+	free(buffer);
+	reset();
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Fuzzes layout demands. The input starts with a layout config, see
+ * read_config(), followed by any amount of layout demands, see
+ * LLVMFuzzerTestOneInput(). Aborts if a view is empty or lies outside of the
+ * output, or if a layout demand takes longer than TIME_BUDGET.
+ */
+
+#define main stacktile_main
+#include "../stacktile.c"
+#undef main
+
+#include "../test/mock-wayland.h"
+
+/* Upper bound on the time of a single layout demand, in nanoseconds. */
+#define TIME_BUDGET 50000000
+
+/* Upper bound on the amount of views of a single layout demand. */
+#define MAX_FUZZ_VIEWS 4096
+
+struct Input
+{
+	const uint8_t *data;
+	size_t size;
+};
+
+/** Takes a little endian value of the given size, zero once the input ends. */
+static uint32_t take (struct Input *input, size_t bytes)
+{
+	uint32_t value = 0;
+	for (size_t i = 0; i < bytes && input->size > 0; i++)
+	{
+		value |= (uint32_t)*input->data << (8 * i);
+		input->data++;
+		input->size--;
+	}
+	return value;
+}
+
+static void read_config (struct Input *input, struct Layout_config *config)
+{
+	config->inner_padding = take(input, 4);
+	config->outer_padding = take(input, 4);
+	config->all_primary   = take(input, 1) & 1;
+
+	const uint32_t area_count = 1 + take(input, 1) % MAX_AREAS;
+	config->area_count = 0;
+	for (uint32_t i = 0; i < area_count; i++)
+	{
+		struct Area *area = &config->areas[i];
+		area->count     = take(input, 1);
+		area->ratio     = 0.1 + 0.8 * take(input, 1) / 255.0;
+		area->position  = (enum Position)(take(input, 1) % (AUTO + 1));
+		area->sublayout = (enum Sublayout)(take(input, 1) % FIRST_PLUGIN_SUBLAYOUT);
+		area->parent    = (int32_t)(take(input, 1) % (i + 1)) - 1;
+		if (! area_parent_is_valid(config, area->parent))
+			area->parent = -1;
+		config->area_count++;
+	}
+	update_layout_config(config);
+}
+
+static void check_demand (struct Layout *layout, uint32_t view_count, uint32_t width,
+		uint32_t height, uint32_t tags, uint32_t serial)
+{
+	const uint32_t commits = mock_commit_count;
+	const uint64_t start = get_time();
+	mock_layout_demand(layout->river_layout, view_count, width, height, tags, serial);
+	const uint64_t duration = get_time() - start;
+
+	if ( duration > TIME_BUDGET )
+	{
+		fprintf(stderr, "FAIL: \"%s\" on %ux%u, %u views took %.3fms\n", mock_layout_name,
+				width, height, view_count, (double)duration / 1000000.0);
+		abort();
+	}
+	if ( mock_view_count != view_count || mock_commit_count != commits + 1
+			|| mock_commit_serial != serial )
+	{
+		fprintf(stderr, "FAIL: \"%s\" on %ux%u: %u of %u views, %u commits\n",
+				mock_layout_name, width, height, mock_view_count, view_count,
+				mock_commit_count - commits);
+		abort();
+	}
+	for (uint32_t i = 0; i < view_count; i++)
+	{
+		const struct mock_view *view = &mock_views[i];
+		if ( view->width == 0 || view->height == 0 || view->x < 0 || view->y < 0
+				|| ( width > 0 && (uint64_t)view->x + view->width > width )
+				|| ( height > 0 && (uint64_t)view->y + view->height > height ) )
+		{
+			fprintf(stderr, "FAIL: \"%s\" on %ux%u, %u views: view %u is %d,%d %ux%u\n",
+					mock_layout_name, width, height, view_count, i,
+					view->x, view->y, view->width, view->height);
+			abort();
+		}
+	}
+}
+
+int LLVMFuzzerInitialize (int *argc, char ***argv)
+{
+	init_layout_configs();
+	wl_list_init(&outputs);
+	layout_manager = (struct river_layout_manager_v3 *)mock_proxy_create(
+			&river_layout_manager_v3_interface);
+	if (! create_output((struct wl_output *)mock_proxy_create(&wl_output_interface), 1))
+		abort();
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+	struct Output *output = wl_container_of(outputs.next, output, link);
+	struct Layout *layout = &output->layouts[0];
+	struct Input input = { .data = data, .size = size };
+
+	read_config(&input, &namespaces[0].default_layout_config);
+	for (uint32_t serial = 1; input.size > 0; serial++)
+	{
+		const uint32_t view_count = take(&input, 2) % (MAX_FUZZ_VIEWS + 1);
+		const uint32_t width      = take(&input, 2);
+		const uint32_t height     = take(&input, 2);
+		const uint32_t tags       = 1u << (take(&input, 1) % 32);
+		check_demand(layout, view_count, width, height, tags, serial);
+	}
+	return 0;
+}
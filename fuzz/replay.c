@@ -0,0 +1,69 @@
+/*
+ * Runs a fuzzer on the given files without libFuzzer, so that the corpus can
+ * be replayed by "make check" with any compiler.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int LLVMFuzzerInitialize (int *argc, char ***argv);
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size);
+
+static uint8_t *read_file (const char *path, size_t *size)
+{
+	FILE *file = fopen(path, "rb");
+	if ( file == NULL )
+	{
+		perror(path);
+		return NULL;
+	}
+
+	uint8_t *data = NULL;
+	size_t capacity = 0;
+	*size = 0;
+	for (;;)
+	{
+		if ( *size == capacity )
+		{
+			capacity = capacity == 0 ? 4096 : capacity * 2;
+			uint8_t *tmp = realloc(data, capacity);
+			if ( tmp == NULL )
+			{
+				fputs("Failed to allocate.\n", stderr);
+				free(data);
+				fclose(file);
+				return NULL;
+			}
+			data = tmp;
+		}
+		const size_t read = fread(data + *size, 1, capacity - *size, file);
+		if ( read == 0 )
+			break;
+		*size += read;
+	}
+
+	if ( ferror(file) )
+	{
+		perror(path);
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	return data;
+}
+
+int main (int argc, char *argv[])
+{
+	LLVMFuzzerInitialize(&argc, &argv);
+	for (int i = 1; i < argc; i++)
+	{
+		size_t size;
+		uint8_t *data = read_file(argv[i], &size);
+		if ( data == NULL )
+			return EXIT_FAILURE;
+		LLVMFuzzerTestOneInput(data, size);
+		free(data);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#ifndef STACKTILE_PLUGIN_H
+#define STACKTILE_PLUGIN_H
+
+/*
+ * Interface of sublayout plugins, which stacktile loads with --plugin or the
+ * load_plugin command.
+ *
+ * A plugin is a shared object exporting a struct stacktile_plugin named
+ * stacktile_plugin, for example:
+ *
+ *	static void arrange_spiral (struct stacktile_rect *views,
+ *			const struct stacktile_rect *area, uint32_t count,
+ *			uint32_t inner_padding)
+ *	{
+ *		...
+ *	}
+ *
+ *	static const struct stacktile_sublayout sublayouts[] = {
+ *		{ "spiral", arrange_spiral },
+ *	};
+ *
+ *	const struct stacktile_plugin stacktile_plugin = {
+ *		.version         = STACKTILE_PLUGIN_VERSION,
+ *		.sublayout_count = 1,
+ *		.sublayouts      = sublayouts,
+ *	};
+ *
+ * Each sublayout of the plugin can then be used by its name wherever the
+ * built-in sublayouts are accepted. Plugins are never unloaded.
+ */
+
+#include <stdint.h>
+
+#define STACKTILE_PLUGIN_VERSION 1
+#define STACKTILE_PLUGIN_SYMBOL  "stacktile_plugin"
+
+struct stacktile_rect
+{
+	uint32_t x, y, width, height;
+};
+
+/**
+ * Arranges count views in area, writing their dimensions to views, which has
+ * room for exactly count rects. count is never 0. Views which are empty or
+ * lie outside of the output are corrected by stacktile.
+ */
+typedef void (*stacktile_sublayout_func)(struct stacktile_rect *views,
+		const struct stacktile_rect *area, uint32_t count, uint32_t inner_padding);
+
+struct stacktile_sublayout
+{
+	/* A single word, which must not be the name of another sublayout. */
+	const char *name;
+	stacktile_sublayout_func arrange;
+};
+
+struct stacktile_plugin
+{
+	uint32_t version; /* STACKTILE_PLUGIN_VERSION */
+	uint32_t sublayout_count;
+	const struct stacktile_sublayout *sublayouts;
+};
+
+#endif
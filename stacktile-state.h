@@ -0,0 +1,110 @@
+#ifndef STACKTILE_STATE_H
+#define STACKTILE_STATE_H
+
+/*
+ * Layout of the state file stacktile writes when started with --state-file.
+ *
+ * The file is meant to be mapped read-only by status bars and similar tools.
+ * Each output slot is guarded by a seqlock: stacktile increments the sequence
+ * number to an odd value before updating the slot and to an even value after,
+ * so readers can take a consistent snapshot without any system calls by
+ * retrying until they read the same even sequence number before and after
+ * copying the slot. stacktile_state_read_output() does exactly that.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define STACKTILE_STATE_MAGIC       0x4b545453 /* "STTK" */
+#define STACKTILE_STATE_VERSION     1
+#define STACKTILE_STATE_MAX_OUTPUTS 32
+#define STACKTILE_STATE_MAX_AREAS   16
+
+enum stacktile_state_position
+{
+	STACKTILE_STATE_TOP,
+	STACKTILE_STATE_RIGHT,
+	STACKTILE_STATE_BOTTOM,
+	STACKTILE_STATE_LEFT,
+};
+
+enum stacktile_state_sublayout
+{
+	STACKTILE_STATE_COLUMNS,
+	STACKTILE_STATE_ROWS,
+	STACKTILE_STATE_STACK,
+	STACKTILE_STATE_GRID,
+	STACKTILE_STATE_FULL,
+};
+
+struct stacktile_state_area
+{
+	int32_t parent;     /* -1 for the usable area of the output. */
+	uint32_t count;
+	double ratio;
+	uint32_t position;  /* enum stacktile_state_position, as resolved. */
+	uint32_t sublayout; /* enum stacktile_state_sublayout, or past it for plugins. */
+};
+
+struct stacktile_state_output
+{
+	uint32_t sequence;
+
+	/* Name of the wl_output global, 0 if the slot is unused. */
+	uint32_t global_name;
+
+	/* Layout namespace, null-terminated. There is one slot for each
+	 * namespace on each output.
+	 */
+	char namespace[32];
+
+	/* Parameters of the last layout demand. */
+	uint32_t tags;
+	uint32_t view_count;
+	uint32_t width;
+	uint32_t height;
+	uint32_t serial;
+
+	/* The effective layout config for the tags of the last layout demand. */
+	uint32_t tag_config; /* Non-zero if the tags have their own config. */
+	uint32_t inner_padding;
+	uint32_t outer_padding;
+	uint32_t all_primary;
+	uint32_t area_count;
+	struct stacktile_state_area areas[STACKTILE_STATE_MAX_AREAS];
+
+	/* The layout name sent to the compositor, null-terminated. */
+	char layout_name[64];
+
+	/* Amount of times stacktile had to correct view dimensions, for example
+	 * because the padding was too large for the output.
+	 */
+	uint32_t geometry_interventions;
+};
+
+struct stacktile_state
+{
+	uint32_t magic;
+	uint32_t version;
+	int32_t pid;
+	uint32_t max_outputs;
+	struct stacktile_state_output outputs[STACKTILE_STATE_MAX_OUTPUTS];
+};
+
+/**
+ * Copies the output slot into out. Returns false if the slot is being updated
+ * right now, in which case the caller should simply try again.
+ */
+static inline bool stacktile_state_read_output (const struct stacktile_state_output *slot,
+		struct stacktile_state_output *out)
+{
+	const uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+	if ( before & 1 )
+		return false;
+	memcpy(out, slot, sizeof(struct stacktile_state_output));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before;
+}
+
+#endif
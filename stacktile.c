@@ -1,26 +1,62 @@
 #include <assert.h>
 #include <getopt.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <dlfcn.h>
+#include <limits.h>
 #include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #include<wayland-client.h>
 #include<wayland-client-protocol.h>
 
 #include"river-layout-v3.h"
+#include"stacktile-state.h"
+#include"stacktile-plugin.h"
+
+/* The fixed build takes the layout from config.h instead of options and
+ * commands, see config.def.h.
+ */
+#ifdef FIXED_CONFIG
+#include"config.h"
+#else
+#define SUBLAYOUT_COLUMNS 1
+#define SUBLAYOUT_ROWS    1
+#define SUBLAYOUT_STACK   1
+#define SUBLAYOUT_GRID    1
+#define SUBLAYOUT_FULL    1
+
+/* Features which only the fixed build may leave out. */
+#define FLIGHT_RECORDER  1
+#define LATENCY_CRITICAL 1
+#define PERF_COUNTERS    1
+#define STATE_FILE       1
+#endif
 
 /* A few macros to indulge the inner glibc user. */
 #define MIN(a, b) ( a < b ? a : b )
 #define MAX(a, b) ( a > b ? a : b )
 #define CLAMP(a, b, c) ( MIN(MAX(b, c), MAX(MIN(b, c), a)) )
 
+#ifndef FIXED_CONFIG
 const char usage[] =
-	"Usage: stacktile [options...]\n"
+	"Usage: stacktile [options...] [--namespace|--preset <name> [options...]]...\n"
 	"   --per-tag-config\n"
 	"   --inner-padding         <int>\n"
 	"   --outer-padding         <int>\n"
@@ -32,7 +68,78 @@ const char usage[] =
 	"   --secondary-ratio       <float>\n"
 	"   --secondary-sublayout   rows|columns|stack\n"
 	"   --remainder-sublayout   rows|columns|stack\n"
+	"   --area                  <count>:<ratio>:<position>:<sublayout>[:<parent>]\n"
+	"   --plugin                <path>\n"
+	"   --latency-critical[=fifo|rr]\n"
+	"   --perf-counters\n"
+	"   --state-file            <path>\n"
+	"   --flight-recorder-file       <path>\n"
+	"   --flight-recorder-threshold  <usec>\n"
 	"\n";
+#endif
+
+/* Upper bound on the amount of areas a layout may consist of. */
+#define MAX_AREAS 16
+
+/* Upper bound on the amount of layout namespaces served by one process. */
+#ifdef FIXED_CONFIG
+#define MAX_NAMESPACES 1
+#else
+#define MAX_NAMESPACES 8
+#endif
+
+/* Upper bound on the amount of sublayouts, including those of plugins. */
+#define MAX_SUBLAYOUTS 32
+
+/* Upper bound on the length of commands. */
+#define MAX_COMMAND_LENGTH 1024
+
+/* Upper bound on the amount of changes of a layout between layout demands. */
+#define MAX_PENDING_CHANGES 64
+
+/* Upper bound on the amount of named presets. */
+#define MAX_PRESETS 16
+
+/* Size of the buffer holding the name of a preset. */
+#define PRESET_NAME_SIZE 32
+
+/* Upper bound on the amount of per tag set layout configs of all outputs. */
+#define MAX_LAYOUT_CONFIGS 256
+
+/* Upper bound on the amount of disconnected outputs whose layout configs are
+ * kept until they are connected again.
+ */
+#define MAX_RETAINED_OUTPUTS 8
+
+/* Size of the buffer holding the name or description of an output. */
+#define OUTPUT_IDENTITY_SIZE 64
+
+/* Amount of views a view buffer initially has room for. */
+#define INITIAL_VIEW_CAPACITY 128
+
+/* Amount of views view buffers have room for in latency critical mode. */
+#define LATENCY_CRITICAL_VIEW_CAPACITY 1024
+
+/* Amount of stack touched in latency critical mode, so that it is mapped
+ * before the first layout demand.
+ */
+#define LATENCY_CRITICAL_STACK_SIZE (256 * 1024)
+
+/* Amount of tag sets per layout whose view dimensions are kept, so that they
+ * can be reused by later layout demands. The layout of the fixed build never
+ * changes, so its views are just arranged again.
+ */
+#ifdef FIXED_CONFIG
+#define LAYOUT_CACHE_SIZE 1
+#else
+#define LAYOUT_CACHE_SIZE 4
+#endif
+
+/* Amount of events kept by the flight recorder. Must be a power of two. */
+#define FLIGHT_RECORDER_SIZE 256
+
+/* Amount of counters read by --perf-counters. */
+#define PERF_COUNTER_COUNT 4
 
 enum Position
 {
@@ -40,6 +147,11 @@ enum Position
 	RIGHT,
 	BOTTOM,
 	LEFT,
+
+	/* Perpendicular to the previous area split off of the same parent area,
+	 * or to the parent area itself if there is no previous area.
+	 */
+	AUTO,
 };
 
 enum Sublayout
@@ -49,6 +161,9 @@ enum Sublayout
 	STACK,
 	GRID,
 	FULL,
+
+	/* Sublayouts of plugins follow the built-in ones. */
+	FIRST_PLUGIN_SUBLAYOUT,
 };
 
 enum Layout_value_status
@@ -58,6 +173,36 @@ enum Layout_value_status
 	MOD,
 };
 
+struct Rect
+{
+	uint32_t x, y, width, height;
+};
+
+/**
+ * A node of the area tree. Each area is split off of its parent area (or the
+ * usable area of the output) and either holds up to count views arranged in its
+ * sublayout, or is further divided by its child areas.
+ *
+ * Areas are stored in pre-order: parents always precede their children and the
+ * children of an area directly follow it. The last area always takes all
+ * remaining views, regardless of its count.
+ */
+struct Area
+{
+	/* Index of the parent area, or -1 for the usable area of the output. */
+	int32_t parent;
+
+	uint32_t count;
+	double ratio;
+	enum Position position;
+	enum Sublayout sublayout;
+
+	/* Derived from the above by update_layout_config(). */
+	enum Position split_position;
+	uint32_t capacity;
+	uint32_t next;
+};
+
 struct Layout_config
 {
 	struct wl_list link;
@@ -66,66 +211,221 @@ struct Layout_config
 	uint32_t inner_padding;
 	uint32_t outer_padding;
 
-	uint32_t primary_count;
-	double primary_ratio;
-	enum Sublayout primary_sublayout;
-	enum Position primary_position;
+	/* The first area is the primary area, the second one the secondary area
+	 * and the last one the remainder area.
+	 */
+	struct Area areas[MAX_AREAS];
+	uint32_t area_count;
 
-	uint32_t secondary_count;
-	double secondary_ratio;
-	enum Sublayout secondary_sublayout;
+	bool all_primary;
 
-	enum Sublayout remainder_sublayout;
+	/* Summary of the layout, sent to the compositor as layout name. Derived
+	 * by update_layout_config().
+	 */
+	char name[64];
 
-	bool all_primary;
+	/* Identifies the values of the config. Changes whenever the config is
+	 * updated by update_layout_config(), never 0.
+	 */
+	uint64_t generation;
+
+	/* If set, the values of the preset are used instead of the above. Presets
+	 * are shared, so they are copied before being modified.
+	 */
+	struct Layout_config *preset;
 };
 
-struct Output
+#ifndef FIXED_CONFIG
+struct Preset
 {
-	struct wl_list link;
+	char name[PRESET_NAME_SIZE];
+	struct Layout_config config;
+};
+
+enum Change_type
+{
+	/* Changes of single areas. */
+	CHANGE_AREA_COUNT,
+	CHANGE_AREA_RATIO,
+	CHANGE_AREA_SUBLAYOUT,
+	CHANGE_AREA_POSITION,
+
+	CHANGE_REMAINDER_SUBLAYOUT,
+	CHANGE_INNER_PADDING,
+	CHANGE_OUTER_PADDING,
+	CHANGE_ALL_PRIMARY,
+
+	/* Switch to a preset, or save the values to one. */
+	CHANGE_PRESET,
+	CHANGE_SAVE_PRESET,
+};
 
-	struct wl_output       *output;
-	struct river_layout_v3 *layout;
+/** The layout configs a command applies to. */
+enum Command_scope
+{
+	/* The tag set of the next layout demand of the output. */
+	SCOPE_FOCUSED,
 
-	struct wl_list layout_configs;
+	/* The tag set of the next layout demand of each output. */
+	SCOPE_OUTPUTS,
 
-	struct
+	/* All tag sets of the output, and the defaults. */
+	SCOPE_TAGS,
+
+	/* All tag sets of all outputs, and the defaults. */
+	SCOPE_ALL,
+
+	/* The defaults only. */
+	SCOPE_DEFAULT,
+};
+
+/** A change of a layout value, waiting for the next layout demand. */
+struct Pending_change
+{
+	enum Change_type type;
+	enum Layout_value_status status;
+	uint32_t area;
+
+	union
 	{
-		enum Layout_value_status primary_count_status;
-		int32_t primary_count;
+		int32_t integer;
+		double ratio;
+		enum Sublayout sublayout;
+		enum Position position;
+		bool all_primary;
+
+		/* Presets are looked up when the change is applied, so that
+		 * saving a preset and switching to it can be queued together.
+		 */
+		char preset[PRESET_NAME_SIZE];
+	};
+};
+#endif
+
+struct Namespace
+{
+	const char *name;
+
+	bool per_tag_config;
+	struct Layout_config default_layout_config;
+#ifndef FIXED_CONFIG
+	/* The default config as given by the options, restored by reset. */
+	struct Layout_config initial_layout_config;
+#endif
+
+	/* Set if another layout generator already uses the namespace. */
+	bool disabled;
+};
+
+/** Dimensions of views, growing if needed but never shrinking. */
+struct View_buffer
+{
+	struct Rect *views;
+	uint32_t capacity;
+};
 
-		enum Layout_value_status primary_ratio_status;
-		double primary_ratio;
+/** Where the views of an area ended up in the last layout demand. */
+struct Area_result
+{
+	struct Rect rect;
+	uint32_t offset;
+	uint32_t count;
+	uint32_t interventions;
+};
 
-		enum Layout_value_status primary_sublayout_status;
-		enum Sublayout primary_sublayout;
+/**
+ * The view dimensions of the last layout demand of a tag set. As long as the
+ * config and output dimensions stay the same, only the areas whose dimensions
+ * or amount of views changed need to be arranged again.
+ */
+struct Layout_cache
+{
+#ifndef FIXED_CONFIG
+	uint32_t tags;
+	uint64_t generation; /* Of the config, 0 if the cache is unused. */
+	uint32_t width;
+	uint32_t height;
+	uint64_t last_use;
+
+	struct Area_result areas[MAX_AREAS];
+#endif
+	struct View_buffer buffer;
+};
 
-		enum Layout_value_status primary_position_status;
-		enum Position primary_position;
+/** The layout of one namespace on one output. */
+struct Layout
+{
+	struct Output *output;
+	struct Namespace *namespace;
 
-		enum Layout_value_status secondary_count_status;
-		int32_t secondary_count;
+	struct river_layout_v3 *river_layout;
 
-		enum Layout_value_status secondary_ratio_status;
-		double secondary_ratio;
+#ifndef FIXED_CONFIG
+	struct wl_list layout_configs;
 
-		enum Layout_value_status secondary_sublayout_status;
-		enum Sublayout secondary_sublayout;
+	/* Changes in the order of the commands, applied one after another to
+	 * the config of the tag set of the next layout demand. A command may
+	 * depend on the result of the previous one, for example when changing a
+	 * value relatively, so they can not be merged.
+	 */
+	struct Pending_change pending_changes[MAX_PENDING_CHANGES];
+	uint32_t pending_change_count;
 
-		enum Layout_value_status remainder_sublayout_status;
-		enum Sublayout remainder_sublayout;
+	/* Tag set of the last layout demand, if there was one. */
+	bool demanded;
+	uint32_t tags;
+#endif
 
-		enum Layout_value_status inner_padding_status;
-		int32_t inner_padding;
+#if STATE_FILE
+	/* Slot of the layout in the state file, if any. */
+	struct stacktile_state_output *state;
+#endif
 
-		enum Layout_value_status outer_padding_status;
-		int32_t outer_padding;
+	struct Layout_cache cache[LAYOUT_CACHE_SIZE];
+};
 
-		enum Layout_value_status all_primary_status;
-		bool all_primary;
-	} pending_layout_config;
+#if PERF_COUNTERS
+/** Counter values summed up over a kind of event. */
+struct Perf_stats
+{
+	uint64_t events;
+	uint64_t views;
+	uint64_t counters[PERF_COUNTER_COUNT];
+};
+#endif
+
+struct Output
+{
+	struct wl_list link;
+
+	/* Name of the wl_output global, used to identify the output in logs. */
+	uint32_t global_name;
+
+	struct wl_output *output;
+
+	/* One layout for each namespace, in the same order. */
+	struct Layout layouts[MAX_NAMESPACES];
 
 	bool configured;
+
+#if PERF_COUNTERS
+	/* Counted by --perf-counters. */
+	struct Perf_stats demand_stats;
+	struct Perf_stats command_stats;
+#endif
+
+#ifndef FIXED_CONFIG
+	/* Name of the output, or its description if the compositor sends no
+	 * name. Identifies the output across reconnects. Empty if unknown.
+	 */
+	char identity[OUTPUT_IDENTITY_SIZE];
+	bool identity_is_name;
+
+	/* Whether the layout configs kept from a previous connection of the
+	 * output have been looked up already.
+	 */
+	bool restored;
+#endif
 };
 
 struct wl_display  *wl_display;
@@ -136,51 +436,505 @@ struct wl_list outputs;
 bool loop = true;
 int ret = EXIT_FAILURE;
 
-bool per_tag_config = false;
-struct Layout_config default_layout_config = {
-	.primary_count = 1,
-	.primary_ratio = 0.6,
-	.primary_sublayout = ROWS,
-	.primary_position = LEFT,
+#ifndef FIXED_CONFIG
+/* Per tag set layout configs are taken from this pool, so no allocations are
+ * needed while handling layout demands or user commands.
+ */
+struct Layout_config layout_config_pool[MAX_LAYOUT_CONFIGS];
+struct wl_list free_layout_configs;
+
+/* Layout configs of disconnected outputs. They still belong to the pool and
+ * are the first to be recycled when it is exhausted.
+ */
+struct Retained_output
+{
+	char identity[OUTPUT_IDENTITY_SIZE];
+	uint64_t retained; /* Order of retention, 0 if the slot is unused. */
+
+	/* One list for each namespace, in the same order. */
+	struct wl_list layout_configs[MAX_NAMESPACES];
+};
+struct Retained_output retained_outputs[MAX_RETAINED_OUTPUTS];
+uint64_t retain_counter;
+#endif
+
+#if FLIGHT_RECORDER
+enum Flight_event_type
+{
+	EVENT_DEMAND,
+	EVENT_COMMAND,
+	EVENT_CONFIG,
+};
+
+struct Flight_event
+{
+	enum Flight_event_type type;
+	uint32_t output;
+	uint32_t namespace;
+	uint64_t timestamp;
+	uint64_t duration;
+
+	union
+	{
+		struct
+		{
+			uint32_t view_count, width, height, tags, serial;
+			uint32_t interventions;
+		} demand;
+
+		/* Truncated command string. */
+		char command[40];
+
+		struct
+		{
+			uint32_t tags;
+			bool created;
+		} config;
+	};
+};
+
+/* The flight recorder is a ring buffer of the most recent events. Recording
+ * an event only copies it into the next slot, so it is always enabled.
+ */
+struct
+{
+	struct Flight_event events[FLIGHT_RECORDER_SIZE];
+	_Atomic uint64_t head;
+
+	const char *path;
+	uint64_t threshold;
+	bool dump_pending;
+} flight_recorder;
+#endif
+
+/* Source of the generations of layout configs. */
+uint64_t config_generation;
+
+/* Set by --latency-critical. */
+struct Latency_critical
+{
+	bool enabled;
+
+	/* Real-time scheduling policy to switch to, or -1 to keep the normal
+	 * scheduling policy.
+	 */
+	int policy;
+};
+#ifdef FIXED_CONFIG
+static const struct Latency_critical latency_critical = {
+	.enabled = LATENCY_CRITICAL,
+	.policy  = LATENCY_CRITICAL_POLICY,
+};
+#else
+struct Latency_critical latency_critical = { .policy = -1 };
+#endif
+
+#if PERF_COUNTERS
+struct Perf_counter
+{
+	uint32_t type;
+	uint64_t config;
+	const char *name;
+};
+
+const struct Perf_counter hardware_counters[PERF_COUNTER_COUNT] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,    "cycles"        },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,  "instructions"  },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-misses" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,  "cache-misses"  },
+};
+
+/* Used if the hardware counters are not available, for example in virtual
+ * machines.
+ */
+const struct Perf_counter software_counters[PERF_COUNTER_COUNT] = {
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,       "task-clock-ns"    },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page-faults"      },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches" },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,   "cpu-migrations"   },
+};
 
-	.secondary_count = 1,
-	.secondary_ratio = 0.6,
-	.secondary_sublayout = ROWS,
+/* Set by --perf-counters. The counters are read around each layout demand,
+ * user command and sublayout, and summed up per output and per sublayout.
+ */
+struct
+{
+	bool enabled;
 
-	.remainder_sublayout = STACK,
+	/* One counter group, the leader first. */
+	int fds[PERF_COUNTER_COUNT];
+	const struct Perf_counter *counters;
+
+	struct Perf_stats sublayout_stats[MAX_SUBLAYOUTS];
+}
+#ifdef FIXED_CONFIG
+perf_counters = { .enabled = true };
+#else
+perf_counters;
+#endif
+#endif
+
+/* Amount of times the dimensions of the current layout demand had to be
+ * corrected because they would have been empty or out of bounds.
+ */
+uint32_t geometry_interventions;
+
+#if STATE_FILE
+/* Shared memory region exporting the layout state, if enabled. */
+struct stacktile_state *state;
+#ifdef FIXED_CONFIG
+char state_path_buffer[PATH_MAX];
+#endif
+const char *state_path;
+#endif
+
+/* Written to by the signal handler to wake up the main loop. */
+int signal_pipe[2] = { -1, -1 };
+
+struct Namespace namespaces[MAX_NAMESPACES];
+uint32_t namespace_count;
+
+#ifdef FIXED_CONFIG
+#define FIXED_AREA_COUNT (sizeof((struct Area[]){ AREAS }) / sizeof(struct Area))
+_Static_assert(FIXED_AREA_COUNT > 0 && FIXED_AREA_COUNT <= MAX_AREAS,
+		"The layout must have between 1 and MAX_AREAS areas");
+
+struct Namespace default_namespace = {
+	.name = NAMESPACE,
+	.per_tag_config = false,
+	.default_layout_config = {
+		.areas = { AREAS },
+		.area_count = FIXED_AREA_COUNT,
+
+		.inner_padding = INNER_PADDING,
+		.outer_padding = OUTER_PADDING,
+		.all_primary = ALL_PRIMARY,
+	},
+};
+#else
+struct Preset presets[MAX_PRESETS];
+uint32_t preset_count;
 
-	.inner_padding = 10,
-	.outer_padding = 10,
-	.all_primary = false,
+/* Options given before any namespace apply to this namespace, which all
+ * namespaces are based on. If no namespace is given, it is used as is.
+ */
+struct Namespace default_namespace = {
+	.name = "stacktile",
+	.per_tag_config = false,
+	.default_layout_config = {
+		/* Primary. */
+		.areas[0] = {
+			.parent = -1,
+			.count = 1,
+			.ratio = 0.6,
+			.position = LEFT,
+			.sublayout = ROWS,
+		},
+
+		/* Secondary. */
+		.areas[1] = {
+			.parent = -1,
+			.count = 1,
+			.ratio = 0.6,
+			.position = AUTO,
+			.sublayout = ROWS,
+		},
+
+		/* Remainder. */
+		.areas[2] = {
+			.parent = -1,
+			.count = 0,
+			.ratio = 0.6,
+			.position = AUTO,
+			.sublayout = STACK,
+		},
+
+		.area_count = 3,
+
+		.inner_padding = 10,
+		.outer_padding = 10,
+		.all_primary = false,
+	},
+};
+#endif
+
+_Static_assert(TOP == (int)STACKTILE_STATE_TOP && RIGHT == (int)STACKTILE_STATE_RIGHT
+		&& BOTTOM == (int)STACKTILE_STATE_BOTTOM && LEFT == (int)STACKTILE_STATE_LEFT,
+		"Positions must match the state file");
+_Static_assert(COLUMNS == (int)STACKTILE_STATE_COLUMNS && ROWS == (int)STACKTILE_STATE_ROWS
+		&& STACK == (int)STACKTILE_STATE_STACK && GRID == (int)STACKTILE_STATE_GRID
+		&& FULL == (int)STACKTILE_STATE_FULL,
+		"Sublayouts must match the state file");
+_Static_assert(MAX_AREAS == STACKTILE_STATE_MAX_AREAS, "Areas must fit into the state file");
+
+_Static_assert(sizeof(struct Rect) == sizeof(struct stacktile_rect)
+		&& offsetof(struct Rect, x) == offsetof(struct stacktile_rect, x)
+		&& offsetof(struct Rect, y) == offsetof(struct stacktile_rect, y)
+		&& offsetof(struct Rect, width) == offsetof(struct stacktile_rect, width)
+		&& offsetof(struct Rect, height) == offsetof(struct stacktile_rect, height),
+		"Rects must match the plugin interface");
+
+const char *sublayout_names[MAX_SUBLAYOUTS] = {
+	[COLUMNS] = "columns",
+	[ROWS]    = "rows",
+	[STACK]   = "stack",
+	[GRID]    = "grid",
+	[FULL]    = "full",
 };
 
-static void sublayout_full (struct river_layout_v3 *river_layout_v3, uint32_t serial,
-		uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t count)
+#ifndef FIXED_CONFIG
+/* Functions of the sublayouts of plugins, NULL for built-in sublayouts. */
+stacktile_sublayout_func sublayout_plugins[MAX_SUBLAYOUTS];
+uint32_t sublayout_count = FIRST_PLUGIN_SUBLAYOUT;
+#endif
+
+#if FLIGHT_RECORDER
+/** Returns the time of CLOCK_MONOTONIC in nanoseconds. */
+static uint64_t get_time (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+static void flight_recorder_record (const struct Flight_event *event)
+{
+	const uint64_t head = atomic_load_explicit(&flight_recorder.head, memory_order_relaxed);
+	flight_recorder.events[head & (FLIGHT_RECORDER_SIZE - 1)] = *event;
+	atomic_store_explicit(&flight_recorder.head, head + 1, memory_order_release);
+}
+
+static void flight_recorder_dump (void)
+{
+	flight_recorder.dump_pending = false;
+
+	FILE *file = stderr;
+	if ( flight_recorder.path != NULL )
+	{
+		file = fopen(flight_recorder.path, "a");
+		if ( file == NULL )
+		{
+			fprintf(stderr, "ERROR: fopen: %s: %s\n", flight_recorder.path, strerror(errno));
+			return;
+		}
+	}
+
+	const uint64_t head = atomic_load_explicit(&flight_recorder.head, memory_order_acquire);
+	const uint64_t tail = head > FLIGHT_RECORDER_SIZE ? head - FLIGHT_RECORDER_SIZE : 0;
+	fprintf(file, "--- stacktile flight recorder: %lu events ---\n", (unsigned long)(head - tail));
+	for (uint64_t i = tail; i < head; i++)
+	{
+		const struct Flight_event *event = &flight_recorder.events[i & (FLIGHT_RECORDER_SIZE - 1)];
+		fprintf(file, "[%5lu.%06lu] output %-3u %-12s %8.3fus  ",
+				(unsigned long)(event->timestamp / 1000000000),
+				(unsigned long)(event->timestamp % 1000000000 / 1000),
+				event->output, namespaces[event->namespace].name,
+				(double)event->duration / 1000.0);
+		switch (event->type)
+		{
+			case EVENT_DEMAND:
+				fprintf(file, "demand  views %u, %ux%u, tags 0x%08x, serial %u, %u interventions\n",
+						event->demand.view_count, event->demand.width,
+						event->demand.height, event->demand.tags,
+						event->demand.serial, event->demand.interventions);
+				break;
+
+			case EVENT_COMMAND:
+				fprintf(file, "command \"%s\"\n", event->command);
+				break;
+
+			case EVENT_CONFIG:
+				fprintf(file, "config  tags 0x%08x%s\n", event->config.tags,
+						event->config.created ? ", created" : "");
+				break;
+		}
+	}
+
+	if ( file != stderr )
+		fclose(file);
+	else
+		fflush(file);
+}
+#endif
+
+#if PERF_COUNTERS
+static int open_perf_counter (const struct Perf_counter *counter, int group_fd)
+{
+	struct perf_event_attr attr = {
+		.type           = counter->type,
+		.size           = sizeof(struct perf_event_attr),
+		.config         = counter->config,
+		.read_format    = PERF_FORMAT_GROUP,
+		.exclude_kernel = 1,
+		.exclude_hv     = 1,
+	};
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+static bool open_perf_counters (const struct Perf_counter *counters)
+{
+	for (size_t i = 0; i < PERF_COUNTER_COUNT; i++)
+	{
+		perf_counters.fds[i] = open_perf_counter(&counters[i],
+				i == 0 ? -1 : perf_counters.fds[0]);
+		if ( perf_counters.fds[i] == -1 )
+		{
+			const int saved_errno = errno;
+			for (size_t j = 0; j < i; j++)
+				close(perf_counters.fds[j]);
+			errno = saved_errno;
+			return false;
+		}
+	}
+	perf_counters.counters = counters;
+	return true;
+}
+
+static void init_perf_counters (void)
+{
+	if (open_perf_counters(hardware_counters))
+		return;
+	fprintf(stderr, "WARNING: Hardware performance counters not available: %s. Using software counters.\n",
+			strerror(errno));
+	if (open_perf_counters(software_counters))
+		return;
+	fprintf(stderr, "WARNING: perf_event_open: %s. Performance counters disabled.\n",
+			strerror(errno));
+	perf_counters.enabled = false;
+}
+
+static void finish_perf_counters (void)
+{
+	if ( perf_counters.counters == NULL )
+		return;
+	for (size_t i = 0; i < PERF_COUNTER_COUNT; i++)
+		close(perf_counters.fds[i]);
+	perf_counters.counters = NULL;
+}
+
+static bool read_perf_counters (uint64_t values[PERF_COUNTER_COUNT])
+{
+	struct
+	{
+		uint64_t nr;
+		uint64_t values[PERF_COUNTER_COUNT];
+	} group;
+	if ( read(perf_counters.fds[0], &group, sizeof(group)) != (ssize_t)sizeof(group) )
+		return false;
+	memcpy(values, group.values, sizeof(group.values));
+	return true;
+}
+
+/** Adds the counts since start to stats. */
+static void add_perf_counters (struct Perf_stats *stats,
+		const uint64_t start[PERF_COUNTER_COUNT], uint32_t views)
+{
+	uint64_t end[PERF_COUNTER_COUNT];
+	if (! read_perf_counters(end))
+		return;
+	stats->events++;
+	stats->views += views;
+	for (size_t i = 0; i < PERF_COUNTER_COUNT; i++)
+		stats->counters[i] += end[i] - start[i];
+}
+
+static void report_perf_stats (const char *what, const struct Perf_stats *stats)
+{
+	if ( stats->events == 0 )
+		return;
+
+	/* Layout demands and sublayouts are compared per view, commands per
+	 * event.
+	 */
+	const bool per_view = stats->views > 0;
+	fprintf(stderr, "%-28s %10lu events %10lu views\n", what,
+			(unsigned long)stats->events, (unsigned long)stats->views);
+	for (size_t i = 0; i < PERF_COUNTER_COUNT; i++)
+		fprintf(stderr, "    %-18s %14lu %12.1f per %s\n",
+				perf_counters.counters[i].name,
+				(unsigned long)stats->counters[i],
+				(double)stats->counters[i] / (double)(per_view ? stats->views : stats->events),
+				per_view ? "view" : "event");
+}
+
+static void report_output_perf_stats (const struct Output *output)
+{
+	char what[64];
+	snprintf(what, sizeof(what), "output %u demands", output->global_name);
+	report_perf_stats(what, &output->demand_stats);
+	snprintf(what, sizeof(what), "output %u commands", output->global_name);
+	report_perf_stats(what, &output->command_stats);
+}
+
+static void report_perf_counters (void)
+{
+	fprintf(stderr, "--- stacktile performance counters (%s) ---\n",
+			perf_counters.counters == hardware_counters ? "hardware" : "software");
+
+	struct Output *output;
+	wl_list_for_each(output, &outputs, link)
+		report_output_perf_stats(output);
+
+	char what[64];
+	for (uint32_t i = 0; i < MAX_SUBLAYOUTS; i++)
+	{
+		if ( sublayout_names[i] == NULL )
+			continue;
+		snprintf(what, sizeof(what), "sublayout %s", sublayout_names[i]);
+		report_perf_stats(what, &perf_counters.sublayout_stats[i]);
+	}
+	fflush(stderr);
+}
+#endif
+
+#if SUBLAYOUT_COLUMNS || SUBLAYOUT_ROWS || SUBLAYOUT_GRID
+/**
+ * Returns the padding to use between count views placed next to each other
+ * along length, so that each view is at least one pixel long.
+ */
+static uint32_t fit_padding (uint32_t length, uint32_t count, uint32_t padding)
+{
+	if ( count < 2 || padding == 0 )
+		return padding;
+	const uint32_t max = length > count ? (length - count) / (count - 1) : 0;
+	if ( padding <= max )
+		return padding;
+	geometry_interventions++;
+	return max;
+}
+#endif
+
+#if SUBLAYOUT_FULL
+static void sublayout_full (struct Rect *views, const struct Rect *area, uint32_t count)
 {
 	for (uint32_t i = 0; i < count; i++)
-		river_layout_v3_push_view_dimensions(river_layout_v3,
-				(int32_t)x, (int32_t)y,
-				width, height, serial);
+		views[i] = *area;
 }
+#endif
 
-static void sublayout_grid (struct river_layout_v3 *river_layout_v3, uint32_t serial,
-		uint32_t x, uint32_t y, uint32_t _width, uint32_t _height, uint32_t count,
+#if SUBLAYOUT_GRID
+static void sublayout_grid (struct Rect *views, const struct Rect *area, uint32_t count,
 		uint32_t inner_padding)
 {
 	const uint32_t rows = (uint32_t)sqrt(count);
 	const uint32_t columns = (uint32_t)ceil((float)count / (float)rows);
-	const uint32_t width = ( _width - ((columns - 1) * inner_padding)) / columns;
-	const uint32_t height = ( _height - ((rows - 1) * inner_padding)) / rows;
-	const uint32_t x_offset = width + inner_padding;
-	const uint32_t y_offset = height + inner_padding;
+	const uint32_t x_padding = fit_padding(area->width, columns, inner_padding);
+	const uint32_t y_padding = fit_padding(area->height, rows, inner_padding);
+	const uint32_t width = ( area->width - ((columns - 1) * x_padding)) / columns;
+	const uint32_t height = ( area->height - ((rows - 1) * y_padding)) / rows;
+	const uint32_t x_offset = width + x_padding;
+	const uint32_t y_offset = height + y_padding;
 
 	uint32_t current_column = 0, current_row = 0;
 	for (uint32_t i = 0; i < count; i++)
 	{
-		river_layout_v3_push_view_dimensions(river_layout_v3,
-				(int32_t)(x + (current_row * x_offset)),
-				(int32_t)(y + (current_column * y_offset)),
-				width, height, serial);
+		views[i] = (struct Rect){
+			.x      = area->x + (current_row * x_offset),
+			.y      = area->y + (current_column * y_offset),
+			.width  = width,
+			.height = height,
+		};
 
 		if ( current_row < columns - 1 )
 			current_row++;
@@ -191,133 +945,709 @@ static void sublayout_grid (struct river_layout_v3 *river_layout_v3, uint32_t se
 		}
 	}
 }
+#endif
 
-static void sublayout_stack (struct river_layout_v3 *river_layout_v3, uint32_t serial,
-		uint32_t x, uint32_t y, uint32_t _width, uint32_t _height, uint32_t count)
+#if SUBLAYOUT_STACK
+static void sublayout_stack (struct Rect *views, const struct Rect *area, uint32_t count)
 {
-	const uint32_t width = (uint32_t)(0.95 * (double)_width);
-	const uint32_t height = (uint32_t)(0.95 * (double)_height);
-	const double x_offset = (0.05 * (double)_width) / (count - 1);
-	const double y_offset = (0.05 * (double)_height) / (count - 1);
+	const uint32_t width = (uint32_t)(0.95 * (double)area->width);
+	const uint32_t height = (uint32_t)(0.95 * (double)area->height);
+	const double x_offset = (0.05 * (double)area->width) / (count - 1);
+	const double y_offset = (0.05 * (double)area->height) / (count - 1);
 
 	for (uint32_t i = 0; i < count; i++)
-		river_layout_v3_push_view_dimensions(river_layout_v3,
-				(int32_t)((double)x + (i * x_offset)),
-				(int32_t)((double)y + (i * y_offset)),
-				width, height, serial);
+		views[i] = (struct Rect){
+			.x      = (uint32_t)((double)area->x + (i * x_offset)),
+			.y      = (uint32_t)((double)area->y + (i * y_offset)),
+			.width  = width,
+			.height = height,
+		};
 }
+#endif
 
-static void sublayout_columns (struct river_layout_v3 *river_layout_v3, uint32_t serial,
-		uint32_t x, uint32_t y, uint32_t _width, uint32_t _height, uint32_t count,
+#if SUBLAYOUT_COLUMNS
+static void sublayout_columns (struct Rect *views, const struct Rect *area, uint32_t count,
 		uint32_t inner_padding)
 {
-	const uint32_t width = (_width - ((count - 1) * inner_padding)) / count;
-	const uint32_t height = _height;
+	inner_padding = fit_padding(area->width, count, inner_padding);
+	const uint32_t width = (area->width - ((count - 1) * inner_padding)) / count;
+	const uint32_t height = area->height;
 
 	for (uint32_t i = 0; i < count; i++)
-		river_layout_v3_push_view_dimensions(river_layout_v3,
-				(int32_t)(x + (i * width + (i * inner_padding))),
-				(int32_t)y,
-				width, height, serial);
+		views[i] = (struct Rect){
+			.x      = area->x + (i * width + (i * inner_padding)),
+			.y      = area->y,
+			.width  = width,
+			.height = height,
+		};
 }
+#endif
 
-static void sublayout_rows (struct river_layout_v3 *river_layout_v3, uint32_t serial,
-		uint32_t x, uint32_t y, uint32_t _width, uint32_t _height, uint32_t count,
+#if SUBLAYOUT_ROWS
+static void sublayout_rows (struct Rect *views, const struct Rect *area, uint32_t count,
 		uint32_t inner_padding)
 {
-	const uint32_t width = _width;
-	const uint32_t height = (_height - ((count - 1) * inner_padding)) / count;
+	inner_padding = fit_padding(area->height, count, inner_padding);
+	const uint32_t width = area->width;
+	const uint32_t height = (area->height - ((count - 1) * inner_padding)) / count;
 
 	for (uint32_t i = 0; i < count; i++)
-		river_layout_v3_push_view_dimensions(river_layout_v3,
-				(int32_t)x,
-				(int32_t)(y + (i * height + (i * inner_padding))),
-				width, height, serial);
+		views[i] = (struct Rect){
+			.x      = area->x,
+			.y      = area->y + (i * height + (i * inner_padding)),
+			.width  = width,
+			.height = height,
+		};
 }
+#endif
 
-static void do_sublayout (struct river_layout_v3 *river_layout_v3, uint32_t serial,
-		uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t count,
+/** Arranges count views in the area, writing their dimensions to views. */
+static void do_sublayout (struct Rect *views, const struct Rect *area, uint32_t count,
 		uint32_t inner_padding, enum Sublayout sublayout)
 {
 	if ( count == 0 )
 		return;
 
+#ifndef FIXED_CONFIG
+	/* Plugins also get to arrange single views, they may not want them to
+	 * fill the area.
+	 */
+	if ( sublayout_plugins[sublayout] != NULL )
+	{
+		sublayout_plugins[sublayout]((struct stacktile_rect *)views,
+				(const struct stacktile_rect *)area, count, inner_padding);
+		return;
+	}
+#endif
+
 	if ( count  == 1 )
 	{
-		river_layout_v3_push_view_dimensions(river_layout_v3,
-				(int32_t)x, (int32_t)y, width, height, serial);
+		views[0] = *area;
 		return;
 	}
 
 	switch (sublayout)
 	{
-		case COLUMNS: sublayout_columns(river_layout_v3, serial, x, y, width, height, count, inner_padding); break;
-		case ROWS:       sublayout_rows(river_layout_v3, serial, x, y, width, height, count, inner_padding); break;
-		case STACK:     sublayout_stack(river_layout_v3, serial, x, y, width, height, count); break;
-		case GRID:       sublayout_grid(river_layout_v3, serial, x, y, width, height, count, inner_padding); break;
-		case FULL:       sublayout_full(river_layout_v3, serial, x, y, width, height, count); break;
+#if SUBLAYOUT_COLUMNS
+		case COLUMNS: sublayout_columns(views, area, count, inner_padding); break;
+#endif
+#if SUBLAYOUT_ROWS
+		case ROWS:       sublayout_rows(views, area, count, inner_padding); break;
+#endif
+#if SUBLAYOUT_STACK
+		case STACK:     sublayout_stack(views, area, count); break;
+#endif
+#if SUBLAYOUT_GRID
+		case GRID:       sublayout_grid(views, area, count, inner_padding); break;
+#endif
+#if SUBLAYOUT_FULL
+		case FULL:       sublayout_full(views, area, count); break;
+#endif
+		default: break;
+	}
+}
+
+/**
+ * Divides length into a part of the given ratio, the padding and the rest.
+ * The padding is shrunk if either part would otherwise be empty.
+ */
+static uint32_t split_length (uint32_t length, double ratio, uint32_t *padding)
+{
+	if ( length < 2 )
+	{
+		if ( *padding != 0 )
+			geometry_interventions++;
+		*padding = 0;
+		return length;
+	}
+
+	if ( *padding > length - 2 )
+	{
+		geometry_interventions++;
+		*padding = length - 2;
 	}
+
+	uint32_t part = (uint32_t)((double)length * ratio);
+	part = part > *padding / 2 ? part - (*padding / 2) : 0;
+	return CLAMP(part, 1, length - *padding - 1);
 }
 
-/** Split off an area from the input area. */
-static void split_off_area (uint32_t *a_x, uint32_t *a_y, uint32_t *a_width, uint32_t *a_height,
-		uint32_t *b_x, uint32_t *b_y, uint32_t *b_width, uint32_t *b_height,
-		uint32_t inner_padding, double ratio, enum Position position)
+/** Split off area b from area a. */
+static void split_off_area (struct Rect *a, struct Rect *b, uint32_t inner_padding,
+		double ratio, enum Position position)
 {
 	switch (position)
 	{
 		case TOP:
-			*b_x       = *a_x;
-			*b_y       = *a_y;
-			*b_width   = *a_width;
-			*b_height  = (uint32_t)((double)*a_height * ratio) - (inner_padding / 2);
-			*a_y      += *b_height + inner_padding;
-			*a_height -= *b_height + inner_padding;
+			b->x       = a->x;
+			b->y       = a->y;
+			b->width   = a->width;
+			b->height  = split_length(a->height, ratio, &inner_padding);
+			a->y      += b->height + inner_padding;
+			a->height -= b->height + inner_padding;
 			break;
 
 		case BOTTOM:
-			*b_width   = *a_width;
-			*b_height  = (uint32_t)((double)*a_height * ratio) - (inner_padding / 2);
-			*a_height -= *b_height + inner_padding;
-			*b_x       = *a_x;
-			*b_y       = *a_y + *a_height + inner_padding;
+			b->width   = a->width;
+			b->height  = split_length(a->height, ratio, &inner_padding);
+			a->height -= b->height + inner_padding;
+			b->x       = a->x;
+			b->y       = a->y + a->height + inner_padding;
 			break;
 
+		case AUTO: /* Resolved by update_layout_config(), never reaches this. */
 		case LEFT:
-			*b_x       = *a_x;
-			*b_y       = *a_y;
-			*b_width   = (uint32_t)((double)*a_width * ratio) - (inner_padding / 2);
-			*b_height  = *a_height;
-			*a_x      += *b_width + inner_padding;
-			*a_width  -= *b_width + inner_padding;
+			b->x       = a->x;
+			b->y       = a->y;
+			b->width   = split_length(a->width, ratio, &inner_padding);
+			b->height  = a->height;
+			a->x      += b->width + inner_padding;
+			a->width  -= b->width + inner_padding;
 			break;
 
 		case RIGHT:
-			*b_width  = (uint32_t)((double)*a_width * ratio) - (inner_padding / 2);
-			*b_height = *a_height;
-			*a_width -= *b_width + inner_padding;
-			*b_x      = *a_x + *a_width + inner_padding;
-			*b_y      = *a_y;
+			b->width  = split_length(a->width, ratio, &inner_padding);
+			b->height = a->height;
+			a->width -= b->width + inner_padding;
+			b->x      = a->x + a->width + inner_padding;
+			b->y      = a->y;
 			break;
 	}
 }
 
 /**
- * Returns a layout config pointer for the given tag set, taking into account
- * the pending layout configuration.
- * 
- * The returned config should not be modified.
+ * Last line of defense against pathological dimensions: Ensures each view is
+ * at least one pixel large and lies within the usable area.
  */
-static struct Layout_config *get_layout_config (struct Output *output, uint32_t tags)
+static void sanitize_views (struct Rect *views, uint32_t count, const struct Rect *usable)
 {
-	struct Layout_config *config = NULL, *tmp;
-	if (per_tag_config)
+	for (uint32_t i = 0; i < count; i++)
 	{
-		wl_list_for_each(tmp, &output->layout_configs, link)
-			if ( tmp->tags == tags )
-			{
-				config = tmp;
-				break;
+		const struct Rect old = views[i];
+		struct Rect *view = &views[i];
+		view->width  = CLAMP(view->width, 1, MAX(usable->width, 1));
+		view->height = CLAMP(view->height, 1, MAX(usable->height, 1));
+		view->x      = CLAMP(view->x, usable->x, usable->x + MAX(usable->width, 1) - view->width);
+		view->y      = CLAMP(view->y, usable->y, usable->y + MAX(usable->height, 1) - view->height);
+		if ( memcmp(&old, view, sizeof(struct Rect)) != 0 )
+			geometry_interventions++;
+	}
+}
+
+/** Makes sure the view buffer can hold at least count views. */
+static bool reserve_views (struct View_buffer *buffer, uint32_t count)
+{
+	if ( count <= buffer->capacity )
+		return true;
+
+	uint32_t capacity = MAX(buffer->capacity, INITIAL_VIEW_CAPACITY);
+	while ( capacity < count )
+		capacity = capacity > UINT32_MAX / 2 ? count : capacity * 2;
+
+	struct Rect *views = realloc(buffer->views, capacity * sizeof(struct Rect));
+	if ( views == NULL )
+	{
+		fprintf(stderr, "ERROR: realloc: %s\n", strerror(errno));
+		return false;
+	}
+	buffer->views = views;
+	buffer->capacity = capacity;
+	return true;
+}
+
+static enum Position perpendicular_position (enum Position position)
+{
+	return (position == LEFT || position == RIGHT) ? TOP : LEFT;
+}
+
+/**
+ * Checks whether an area with the given parent may be appended to the area
+ * tree of the config without breaking its pre-order. That is the case if the
+ * parent is the last area or one of its ancestors.
+ */
+static bool area_parent_is_valid (struct Layout_config *config, int32_t parent)
+{
+	if ( parent < -1 || parent >= (int32_t)config->area_count )
+		return false;
+	if ( parent == -1 )
+		return true;
+	for (int32_t i = (int32_t)config->area_count - 1; i != -1; i = config->areas[i].parent)
+		if ( i == parent )
+			return true;
+	return false;
+}
+
+/**
+ * Summarizes the layout as the counts and sublayouts of the areas which hold
+ * views, for example "1 rows | 1 rows | stack".
+ */
+static void update_layout_name (struct Layout_config *config)
+{
+	if (config->all_primary)
+	{
+		uint32_t i = 0;
+		while ( config->areas[i].next != i + 1 )
+			i++;
+		snprintf(config->name, sizeof(config->name), "all %s",
+				sublayout_names[config->areas[i].sublayout]);
+		return;
+	}
+
+	size_t len = 0;
+	config->name[0] = '\0';
+	for (uint32_t i = 0; i < config->area_count && len < sizeof(config->name); i++)
+	{
+		const struct Area *area = &config->areas[i];
+		if ( area->next != i + 1 || area->capacity == 0 )
+			continue;
+		const int written = area->capacity == UINT32_MAX ?
+			snprintf(config->name + len, sizeof(config->name) - len, "%s%s",
+					len > 0 ? " | " : "", sublayout_names[area->sublayout]) :
+			snprintf(config->name + len, sizeof(config->name) - len, "%s%u %s",
+					len > 0 ? " | " : "", area->count, sublayout_names[area->sublayout]);
+		if ( written < 0 )
+			break;
+		len += (size_t)written;
+	}
+}
+
+/**
+ * Updates the derived fields of the config. Must be called after the config
+ * has been changed.
+ */
+static void update_layout_config (struct Layout_config *config)
+{
+	/* Positions are resolved front to back, as an automatic position depends
+	 * on the previous sibling area, or the parent area if there is none. The
+	 * first slot is for areas split off of the usable area, for which an
+	 * automatic position results in LEFT.
+	 */
+	enum Position previous[MAX_AREAS + 1];
+	previous[0] = TOP;
+	for (uint32_t i = 0; i < config->area_count; i++)
+	{
+		struct Area *area = &config->areas[i];
+		const size_t slot = (size_t)(area->parent + 1);
+		area->split_position = area->position == AUTO ?
+				perpendicular_position(previous[slot]) : area->position;
+		previous[slot] = area->split_position;
+		previous[i + 1] = area->split_position;
+	}
+
+	/* The extent of subtrees and the amount of views an area can hold are
+	 * resolved back to front, as they depend on the child areas.
+	 */
+	for (uint32_t i = config->area_count; i-- > 0; )
+	{
+		struct Area *area = &config->areas[i];
+
+		area->next = i + 1;
+		area->capacity = 0;
+		while ( area->next < config->area_count
+				&& config->areas[area->next].parent == (int32_t)i )
+		{
+			const struct Area *child = &config->areas[area->next];
+			area->capacity = child->capacity > UINT32_MAX - area->capacity ?
+					UINT32_MAX : area->capacity + child->capacity;
+			area->next = child->next;
+		}
+
+		if ( area->next == i + 1 )
+			area->capacity = i == config->area_count - 1 ? UINT32_MAX : area->count;
+	}
+
+	update_layout_name(config);
+	config->generation = ++config_generation;
+}
+
+#if LATENCY_CRITICAL
+/** Touches every page of the memory, so that it is mapped before it is used. */
+static void prefault (void *memory, size_t size)
+{
+	volatile char *bytes = memory;
+	const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	for (size_t i = 0; i < size; i += page_size)
+		bytes[i] = bytes[i];
+}
+
+static void prefault_stack (void)
+{
+	volatile char stack[LATENCY_CRITICAL_STACK_SIZE];
+	prefault((void *)stack, sizeof(stack));
+}
+
+/**
+ * Makes sure the memory used when handling layout demands stays resident, so
+ * that demands are not delayed by page faults even if the system is swapping,
+ * and switches to a real-time scheduling policy if requested. Failures are
+ * not fatal, stacktile just runs with a higher latency then.
+ */
+static void init_latency_critical (void)
+{
+	prefault_stack();
+#if FLIGHT_RECORDER
+	prefault(&flight_recorder, sizeof(flight_recorder));
+#endif
+#ifndef FIXED_CONFIG
+	prefault(layout_config_pool, sizeof(layout_config_pool));
+	prefault(presets, sizeof(presets));
+#endif
+
+	/* MCL_FUTURE also locks everything allocated later on, like outputs. */
+	if ( mlockall(MCL_CURRENT | MCL_FUTURE) == -1 )
+		fprintf(stderr, "WARNING: mlockall: %s. Memory of stacktile may be swapped out.\n",
+				strerror(errno));
+
+	if ( latency_critical.policy == -1 )
+		return;
+	const struct sched_param param = {
+		.sched_priority = sched_get_priority_min(latency_critical.policy),
+	};
+	if ( sched_setscheduler(0, latency_critical.policy, &param) == -1 )
+		fprintf(stderr, "WARNING: sched_setscheduler: %s. Keeping the normal scheduling policy.\n",
+				strerror(errno));
+}
+#endif
+
+#ifndef FIXED_CONFIG
+static void init_layout_config_pool (void)
+{
+	wl_list_init(&free_layout_configs);
+	for (size_t i = 0; i < MAX_LAYOUT_CONFIGS; i++)
+		wl_list_insert(&free_layout_configs, &layout_config_pool[i].link);
+	for (size_t i = 0; i < MAX_RETAINED_OUTPUTS; i++)
+		for (size_t j = 0; j < MAX_NAMESPACES; j++)
+			wl_list_init(&retained_outputs[i].layout_configs[j]);
+}
+
+static void release_layout_config (struct Layout_config *config)
+{
+	wl_list_remove(&config->link);
+	wl_list_insert(&free_layout_configs, &config->link);
+}
+
+static void drop_retained_output (struct Retained_output *retained)
+{
+	struct Layout_config *config, *tmp;
+	for (uint32_t i = 0; i < namespace_count; i++)
+		wl_list_for_each_safe(config, tmp, &retained->layout_configs[i], link)
+			release_layout_config(config);
+	retained->retained = 0;
+}
+
+/** Returns the least recently retained output, or NULL if there is none. */
+static struct Retained_output *get_oldest_retained_output (void)
+{
+	struct Retained_output *oldest = NULL;
+	for (size_t i = 0; i < MAX_RETAINED_OUTPUTS; i++)
+		if ( retained_outputs[i].retained != 0 && ( oldest == NULL
+					|| retained_outputs[i].retained < oldest->retained ) )
+			oldest = &retained_outputs[i];
+	return oldest;
+}
+
+static struct Retained_output *find_retained_output (const char *identity)
+{
+	for (size_t i = 0; i < MAX_RETAINED_OUTPUTS; i++)
+		if ( retained_outputs[i].retained != 0
+				&& ! strcmp(retained_outputs[i].identity, identity) )
+			return &retained_outputs[i];
+	return NULL;
+}
+
+/**
+ * Takes a layout config from the pool. If the pool is exhausted, the configs
+ * of disconnected outputs are recycled first, then the least recently created
+ * config of the layout.
+ */
+static struct Layout_config *acquire_layout_config (struct Layout *layout)
+{
+	struct Layout_config *config;
+	struct Retained_output *retained;
+	while ( wl_list_empty(&free_layout_configs)
+			&& ( retained = get_oldest_retained_output() ) != NULL )
+		drop_retained_output(retained);
+	if (! wl_list_empty(&free_layout_configs))
+		config = wl_container_of(free_layout_configs.next, config, link);
+	else if (! wl_list_empty(&layout->layout_configs))
+		config = wl_container_of(layout->layout_configs.prev, config, link);
+	else
+		return NULL;
+	wl_list_remove(&config->link);
+	return config;
+}
+
+/**
+ * Keeps the layout configs of an output which is about to be destroyed, so
+ * they can be given back to it when it is connected again.
+ */
+static void retain_layout_configs (struct Output *output)
+{
+	if ( output->identity[0] == '\0' )
+		return;
+
+	bool empty = true;
+	for (uint32_t i = 0; i < namespace_count; i++)
+		if (! wl_list_empty(&output->layouts[i].layout_configs))
+			empty = false;
+	if (empty)
+		return;
+
+	struct Retained_output *retained = find_retained_output(output->identity);
+	for (size_t i = 0; retained == NULL && i < MAX_RETAINED_OUTPUTS; i++)
+		if ( retained_outputs[i].retained == 0 )
+			retained = &retained_outputs[i];
+	if ( retained == NULL )
+		retained = get_oldest_retained_output();
+	drop_retained_output(retained);
+
+	strcpy(retained->identity, output->identity);
+	retained->retained = ++retain_counter;
+	for (uint32_t i = 0; i < namespace_count; i++)
+	{
+		struct wl_list *configs = &output->layouts[i].layout_configs;
+		wl_list_insert_list(&retained->layout_configs[i], configs);
+		wl_list_init(configs);
+	}
+}
+
+/**
+ * Gives the layout configs kept from a previous connection back to the
+ * output. Tag sets which have been changed since it was connected keep their
+ * current config.
+ */
+static void restore_layout_configs (struct Output *output)
+{
+	struct Retained_output *retained = find_retained_output(output->identity);
+	if ( retained == NULL )
+		return;
+
+	for (uint32_t i = 0; i < namespace_count; i++)
+	{
+		struct Layout *layout = &output->layouts[i];
+		struct Layout_config *config, *tmp, *existing;
+		wl_list_for_each_safe(config, tmp, &retained->layout_configs[i], link)
+		{
+			bool found = false;
+			wl_list_for_each(existing, &layout->layout_configs, link)
+				if ( existing->tags == config->tags )
+				{
+					found = true;
+					break;
+				}
+			if (found)
+				release_layout_config(config);
+			else
+			{
+				/* Older than any config of the layout, so appended. */
+				wl_list_remove(&config->link);
+				wl_list_insert(layout->layout_configs.prev, &config->link);
+			}
+		}
+	}
+	retained->retained = 0;
+}
+
+/** Copies the layout values of src to dst, leaving dst in its list. */
+static void copy_layout_values (struct Layout_config *dst, const struct Layout_config *src)
+{
+	struct wl_list link = dst->link;
+	const uint32_t tags = dst->tags;
+	memcpy(dst, src, sizeof(struct Layout_config));
+	dst->link   = link;
+	dst->tags   = tags;
+	dst->preset = NULL;
+}
+
+static struct Layout_config *effective_config (struct Layout_config *config)
+{
+	return config->preset != NULL ? config->preset : config;
+}
+
+/** Returns the preset with the given name, or NULL if there is none. */
+static struct Preset *find_preset (const char *name)
+{
+	for (uint32_t i = 0; i < preset_count; i++)
+		if (! strcmp(presets[i].name, name))
+			return &presets[i];
+	return NULL;
+}
+
+/**
+ * Returns the preset with the given name, adding it if needed. An added
+ * preset has no values, so they must be set right away.
+ */
+static struct Preset *add_preset (const char *name)
+{
+	struct Preset *preset = find_preset(name);
+	if ( preset != NULL )
+		return preset;
+	if ( preset_count == MAX_PRESETS )
+	{
+		fprintf(stderr, "ERROR: Too many presets. At most %d presets are supported.\n", MAX_PRESETS);
+		return NULL;
+	}
+	preset = &presets[preset_count++];
+	strcpy(preset->name, name);
+	return preset;
+}
+
+static bool has_pending_changes (struct Layout *layout)
+{
+	return layout->pending_change_count > 0;
+}
+
+/**
+ * Returns value changed by delta, or value itself if the result would be
+ * negative or too large.
+ */
+static uint32_t add_delta (uint32_t value, int32_t delta)
+{
+	const int64_t result = (int64_t)value + delta;
+	return ( result < 0 || result > INT32_MAX ) ? value : (uint32_t)result;
+}
+
+/**
+ * Applies a change to the config. If the config uses a preset, the values of
+ * the preset are copied first, so that the preset itself stays unchanged.
+ */
+static void apply_change (struct Layout_config *config, const struct Pending_change *change)
+{
+	if ( change->type == CHANGE_PRESET )
+	{
+		struct Preset *preset = find_preset(change->preset);
+		if ( preset == NULL )
+		{
+			fprintf(stderr, "ERROR: Unknown preset: %s\n", change->preset);
+			return;
+		}
+		if ( preset->config.area_count == 0 )
+		{
+			fprintf(stderr, "ERROR: Preset has no areas: %s\n", change->preset);
+			return;
+		}
+		config->preset = &preset->config;
+		return;
+	}
+
+	if ( change->type == CHANGE_SAVE_PRESET )
+	{
+		struct Preset *preset = add_preset(change->preset);
+		if ( preset == NULL || effective_config(config) == &preset->config )
+			return;
+		copy_layout_values(&preset->config, effective_config(config));
+		update_layout_config(&preset->config);
+		return;
+	}
+
+	if ( config->preset != NULL )
+		copy_layout_values(config, config->preset);
+
+	struct Area *area = &config->areas[change->area];
+
+	/* Changes to areas the config does not have are dropped. */
+	if ( change->type <= CHANGE_AREA_POSITION && change->area >= config->area_count )
+		return;
+
+	switch (change->type)
+	{
+		case CHANGE_AREA_COUNT:
+			if ( change->status == NEW )
+				area->count = (uint32_t)change->integer;
+			else
+				area->count = add_delta(area->count, change->integer);
+			break;
+
+		case CHANGE_AREA_RATIO:
+			if ( change->status == NEW )
+				area->ratio = CLAMP(change->ratio, 0.1, 0.9);
+			else
+				area->ratio = CLAMP(area->ratio + change->ratio, 0.1, 0.9);
+			break;
+
+		case CHANGE_AREA_SUBLAYOUT:
+			area->sublayout = change->sublayout;
+			break;
+
+		case CHANGE_AREA_POSITION:
+			area->position = change->position;
+			break;
+
+		case CHANGE_REMAINDER_SUBLAYOUT:
+			config->areas[config->area_count - 1].sublayout = change->sublayout;
+			break;
+
+		case CHANGE_INNER_PADDING:
+			if ( change->status == NEW )
+				config->inner_padding = (uint32_t)change->integer;
+			else
+				config->inner_padding = add_delta(config->inner_padding, change->integer);
+			break;
+
+		case CHANGE_OUTER_PADDING:
+			if ( change->status == NEW )
+				config->outer_padding = (uint32_t)change->integer;
+			else
+				config->outer_padding = add_delta(config->outer_padding, change->integer);
+			break;
+
+		case CHANGE_ALL_PRIMARY:
+			if ( change->status == NEW )
+				config->all_primary = change->all_primary;
+			else
+				config->all_primary = !config->all_primary;
+			break;
+
+		case CHANGE_PRESET:
+		case CHANGE_SAVE_PRESET:
+			/* Handled above. */
+			break;
+	}
+}
+
+/**
+ * Applies changes sent to the layout to a config and records it in the flight
+ * recorder, whether they were queued or are applied right away.
+ */
+static void apply_changes (struct Layout *layout, struct Layout_config *config,
+		const struct Pending_change *changes, uint32_t count, bool created)
+{
+	struct Flight_event event = {
+		.type = EVENT_CONFIG,
+		.output = layout->output->global_name,
+		.namespace = (uint32_t)(layout->namespace - namespaces),
+		.timestamp = get_time(),
+		.config.tags = config->tags,
+		.config.created = created,
+	};
+
+	for (uint32_t i = 0; i < count; i++)
+		apply_change(config, &changes[i]);
+	update_layout_config(config);
+
+	event.duration = get_time() - event.timestamp;
+	flight_recorder_record(&event);
+}
+
+/**
+ * Returns a layout config pointer for the given tag set, taking into account
+ * the pending layout configuration. This is either the default config of the
+ * namespace or the config of the tag set, either of which may use a preset,
+ * see effective_config().
+ * 
+ * The returned config should not be modified.
+ */
+static struct Layout_config *get_layout_config (struct Layout *layout, uint32_t tags)
+{
+	struct Layout_config *config = NULL, *tmp;
+	bool created = false;
+	if (layout->namespace->per_tag_config)
+	{
+		wl_list_for_each(tmp, &layout->layout_configs, link)
+			if ( tmp->tags == tags )
+			{
+				config = tmp;
+				break;
 			}
 
 		if ( config == NULL )
@@ -325,450 +1655,1305 @@ static struct Layout_config *get_layout_config (struct Output *output, uint32_t
 			/* No config has been found. If there are pending changes, we
 			 * need to create a new one based on the default config.
 			 */
-			if ( output->pending_layout_config.primary_count_status != UNCHANGED
-					|| output->pending_layout_config.primary_ratio_status != UNCHANGED
-					|| output->pending_layout_config.primary_sublayout_status != UNCHANGED
-					|| output->pending_layout_config.primary_position_status != UNCHANGED
-					|| output->pending_layout_config.secondary_count_status!= UNCHANGED
-					|| output->pending_layout_config.secondary_ratio_status != UNCHANGED
-					|| output->pending_layout_config.secondary_sublayout_status != UNCHANGED
-					|| output->pending_layout_config.remainder_sublayout_status != UNCHANGED
-					|| output->pending_layout_config.inner_padding_status != UNCHANGED
-					|| output->pending_layout_config.outer_padding_status != UNCHANGED
-					|| output->pending_layout_config.all_primary_status != UNCHANGED)
+			if (has_pending_changes(layout))
 			{
-				config = calloc(1, sizeof(struct Layout_config));
+				config = acquire_layout_config(layout);
 				if ( config == NULL )
 				{
-					fprintf(stderr, "ERROR: calloc: %s\n", strerror(errno));
-					return &default_layout_config;
+					/* The default config is shared by all outputs, so
+					 * changes meant for one tag set are not applied to it.
+					 */
+					fputs("ERROR: Out of layout configs. Dropping the pending changes.\n",
+							stderr);
+					layout->pending_change_count = 0;
+					return &layout->namespace->default_layout_config;
 				}
-				memcpy(config, &default_layout_config, sizeof(struct Layout_config));
+				copy_layout_values(config, effective_config(&layout->namespace->default_layout_config));
 				config->tags = tags;
-				wl_list_insert(&output->layout_configs, &config->link);
+				wl_list_insert(&layout->layout_configs, &config->link);
+				created = true;
 			}
 			else
 			{
 				/* No pending changes, so we can just use the default config. */
-				return &default_layout_config;
+				return &layout->namespace->default_layout_config;
 			}
 		}
 	}
-	else
-		config = &default_layout_config;
+	else
+		config = &layout->namespace->default_layout_config;
+
+	if (! has_pending_changes(layout))
+		return config;
+
+	apply_changes(layout, config, layout->pending_changes, layout->pending_change_count,
+			created);
+	layout->pending_change_count = 0;
+	return config;
+}
+#else
+/**
+ * Checks the parts of the layout of config.h which can not be checked at
+ * compile time.
+ */
+static bool check_fixed_config (struct Layout_config *config)
+{
+	const bool sublayout_available[] = {
+		[COLUMNS] = SUBLAYOUT_COLUMNS,
+		[ROWS]    = SUBLAYOUT_ROWS,
+		[STACK]   = SUBLAYOUT_STACK,
+		[GRID]    = SUBLAYOUT_GRID,
+		[FULL]    = SUBLAYOUT_FULL,
+	};
+
+	const uint32_t area_count = config->area_count;
+	bool ret = true;
+	for (uint32_t i = 0; i < area_count; i++)
+	{
+		const struct Area *area = &config->areas[i];
+
+		/* area_parent_is_valid() checks appending an area. */
+		config->area_count = i;
+		if (! area_parent_is_valid(config, area->parent))
+		{
+			fprintf(stderr, "ERROR: Area %u: Invalid parent: %d\n", i + 1, area->parent);
+			ret = false;
+		}
+		if ( area->ratio < 0.1 || area->ratio > 0.9 )
+		{
+			fprintf(stderr, "ERROR: Area %u: Ratio must be between 0.1 and 0.9.\n", i + 1);
+			ret = false;
+		}
+		if ( (size_t)area->sublayout >= sizeof(sublayout_available)
+				|| !sublayout_available[area->sublayout] )
+		{
+			fprintf(stderr, "ERROR: Area %u: Sublayout not compiled in.\n", i + 1);
+			ret = false;
+		}
+	}
+	config->area_count = area_count;
+	return ret;
+}
+
+/** There is only a single config, which is never changed. */
+static struct Layout_config *get_layout_config (struct Layout *layout, uint32_t tags)
+{
+	return &namespaces[0].default_layout_config;
+}
+
+static struct Layout_config *effective_config (struct Layout_config *config)
+{
+	return config;
+}
+#endif
+
+#if STATE_FILE
+#ifdef FIXED_CONFIG
+/**
+ * Sets the state path to STATE_FILE_PATH, relative to $XDG_RUNTIME_DIR unless
+ * it is absolute. A fixed path in a shared directory could be taken by
+ * someone else first.
+ */
+static bool set_state_path (void)
+{
+	if ( STATE_FILE_PATH[0] == '/' )
+	{
+		state_path = STATE_FILE_PATH;
+		return true;
+	}
+
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+	if ( runtime_dir == NULL || runtime_dir[0] == '\0' )
+	{
+		fputs("ERROR: XDG_RUNTIME_DIR is not set, there is no place for the state file.\n",
+				stderr);
+		return false;
+	}
+	const int length = snprintf(state_path_buffer, sizeof(state_path_buffer), "%s/%s",
+			runtime_dir, STATE_FILE_PATH);
+	if ( length < 0 || (size_t)length >= sizeof(state_path_buffer) )
+	{
+		fputs("ERROR: The path of the state file is too long.\n", stderr);
+		return false;
+	}
+	state_path = state_path_buffer;
+	return true;
+}
+#endif
+
+static bool init_state_file (void)
+{
+#ifdef FIXED_CONFIG
+	if (! set_state_path())
+		return false;
+#endif
+	if ( state_path == NULL )
+		return true;
+
+	/* The file is truncated, so it must not be a link to or a file of
+	 * someone else.
+	 */
+	const int fd = open(state_path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if ( fd == -1 )
+	{
+		fprintf(stderr, "ERROR: open: %s: %s\n", state_path, strerror(errno));
+		return false;
+	}
+	struct stat st;
+	if ( fstat(fd, &st) == -1 )
+	{
+		fprintf(stderr, "ERROR: fstat: %s: %s\n", state_path, strerror(errno));
+		close(fd);
+		return false;
+	}
+	if ( !S_ISREG(st.st_mode) || st.st_uid != getuid() )
+	{
+		fprintf(stderr, "ERROR: %s: Not a regular file owned by the user.\n", state_path);
+		close(fd);
+		return false;
+	}
+
+	/* Truncating first clears any state left over by a previous instance. */
+	if ( ftruncate(fd, 0) == -1 || ftruncate(fd, sizeof(struct stacktile_state)) == -1 )
+	{
+		fprintf(stderr, "ERROR: ftruncate: %s: %s\n", state_path, strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	void *region = mmap(NULL, sizeof(struct stacktile_state), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if ( region == MAP_FAILED )
+	{
+		fprintf(stderr, "ERROR: mmap: %s: %s\n", state_path, strerror(errno));
+		return false;
+	}
+
+	state = region;
+	state->version     = STACKTILE_STATE_VERSION;
+	state->pid         = (int32_t)getpid();
+	state->max_outputs = STACKTILE_STATE_MAX_OUTPUTS;
+	__atomic_store_n(&state->magic, STACKTILE_STATE_MAGIC, __ATOMIC_RELEASE);
+	return true;
+}
+
+static void finish_state_file (void)
+{
+	if ( state == NULL )
+		return;
+	munmap(state, sizeof(struct stacktile_state));
+	state = NULL;
+}
+
+static void state_write_begin (struct stacktile_state_output *slot)
+{
+	__atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void state_write_end (struct stacktile_state_output *slot)
+{
+	__atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE);
+}
+
+static struct stacktile_state_output *acquire_state_slot (uint32_t global_name,
+		const char *namespace)
+{
+	if ( state == NULL )
+		return NULL;
+	for (size_t i = 0; i < STACKTILE_STATE_MAX_OUTPUTS; i++)
+	{
+		struct stacktile_state_output *slot = &state->outputs[i];
+		if ( slot->global_name != 0 )
+			continue;
+		state_write_begin(slot);
+		slot->global_name = global_name;
+		strncpy(slot->namespace, namespace, sizeof(slot->namespace) - 1);
+		state_write_end(slot);
+		return slot;
+	}
+	fputs("ERROR: Too many layouts for the state file.\n", stderr);
+	return NULL;
+}
+
+static void release_state_slot (struct stacktile_state_output *slot)
+{
+	if ( slot == NULL )
+		return;
+	state_write_begin(slot);
+	memset((char *)slot + sizeof(slot->sequence), 0, sizeof(*slot) - sizeof(slot->sequence));
+	state_write_end(slot);
+}
+
+static void publish_state (struct Layout *layout, const struct Layout_config *config,
+		bool tag_config, uint32_t view_count, uint32_t width, uint32_t height,
+		uint32_t tags, uint32_t serial)
+{
+	struct stacktile_state_output *slot = layout->state;
+	if ( slot == NULL )
+		return;
+
+	state_write_begin(slot);
+
+	slot->geometry_interventions += geometry_interventions;
+	slot->tags          = tags;
+	slot->view_count    = view_count;
+	slot->width         = width;
+	slot->height        = height;
+	slot->serial        = serial;
+	slot->tag_config    = tag_config;
+	slot->inner_padding = config->inner_padding;
+	slot->outer_padding = config->outer_padding;
+	slot->all_primary   = config->all_primary;
+	slot->area_count    = config->area_count;
+	for (uint32_t i = 0; i < config->area_count; i++)
+	{
+		slot->areas[i].parent    = config->areas[i].parent;
+		slot->areas[i].count     = config->areas[i].count;
+		slot->areas[i].ratio     = config->areas[i].ratio;
+		slot->areas[i].position  = config->areas[i].split_position;
+		slot->areas[i].sublayout = config->areas[i].sublayout;
+	}
+	memcpy(slot->layout_name, config->name, sizeof(slot->layout_name));
+
+	state_write_end(slot);
+}
+#else
+static bool init_state_file (void)
+{
+	return true;
+}
+
+static void finish_state_file (void)
+{
+}
+#endif
+
+#ifndef FIXED_CONFIG
+/**
+ * Returns the cache of the tag set, or the least recently used one if the tag
+ * set has none. The cached results are dropped if they were computed with a
+ * different config or for different output dimensions.
+ */
+static struct Layout_cache *get_layout_cache (struct Layout *layout,
+		const struct Layout_config *config, uint32_t tags, uint32_t width,
+		uint32_t height, uint64_t now)
+{
+	struct Layout_cache *cache = &layout->cache[0];
+	for (size_t i = 0; i < LAYOUT_CACHE_SIZE; i++)
+	{
+		if ( layout->cache[i].generation != 0 && layout->cache[i].tags == tags )
+		{
+			cache = &layout->cache[i];
+			break;
+		}
+		if ( layout->cache[i].last_use < cache->last_use )
+			cache = &layout->cache[i];
+	}
+
+	cache->last_use = now;
+	if ( cache->generation != config->generation || cache->tags != tags
+			|| cache->width != width || cache->height != height )
+	{
+		cache->tags       = tags;
+		cache->generation = config->generation;
+		cache->width      = width;
+		cache->height     = height;
+		memset(cache->areas, 0, sizeof(cache->areas));
+	}
+	return cache;
+}
+#endif
+
+/**
+ * Arranges the views of an area in the view buffer of the cache. The views of
+ * an area only depend on its dimensions and amount of views, so if those are
+ * the same as in the previous demand, the views are still in the buffer: An
+ * area that is reached always starts after the capacities of all previous
+ * areas, so no other area writes to its part of the buffer.
+ *
+ * Only identical areas are reused. Every sublayout resizes all of its views
+ * when one is added, so the last area, which takes the remaining views, is
+ * arranged again whenever the view count changes.
+ */
+static void place_views (struct Layout_cache *cache, const struct Layout_config *config,
+		uint32_t index, const struct Rect *rect, uint32_t offset, uint32_t count,
+		const struct Rect *usable)
+{
+#ifndef FIXED_CONFIG
+	struct Area_result *result = &cache->areas[index];
+	if ( result->count == count && result->offset == offset
+			&& memcmp(&result->rect, rect, sizeof(struct Rect)) == 0 )
+	{
+		geometry_interventions += result->interventions;
+		return;
+	}
+	const uint32_t interventions = geometry_interventions;
+#endif
+
+	struct Rect *views = &cache->buffer.views[offset];
+#if PERF_COUNTERS
+	uint64_t counters[PERF_COUNTER_COUNT];
+	const bool counted = perf_counters.enabled && read_perf_counters(counters);
+#endif
+	do_sublayout(views, rect, count, config->inner_padding, config->areas[index].sublayout);
+#if PERF_COUNTERS
+	if (counted)
+		add_perf_counters(&perf_counters.sublayout_stats[config->areas[index].sublayout],
+				counters, count);
+#endif
+	sanitize_views(views, count, usable);
+
+#ifndef FIXED_CONFIG
+	result->rect          = *rect;
+	result->offset        = offset;
+	result->count         = count;
+	result->interventions = geometry_interventions - interventions;
+#endif
+}
+
+static void layout_handle_layout_demand (void *data, struct river_layout_v3 *river_layout_v3,
+		uint32_t view_count, uint32_t _width, uint32_t _height, uint32_t tags, uint32_t serial)
+{
+	struct Layout *layout = (struct Layout *)data;
+#if PERF_COUNTERS
+	uint64_t counters[PERF_COUNTER_COUNT];
+	const bool counted = perf_counters.enabled && read_perf_counters(counters);
+#endif
+#if FLIGHT_RECORDER
+	const uint64_t start = get_time();
+#endif
+	struct Layout_config *tag_config = get_layout_config(layout, tags);
+	struct Layout_config *config = effective_config(tag_config);
+#ifndef FIXED_CONFIG
+	layout->demanded = true;
+	layout->tags     = tags;
+#endif
+
+	geometry_interventions = 0;
+
+	/* Outer padding is shrunk so that at least one pixel remains usable. */
+	const uint32_t x_padding = MIN(config->outer_padding, (_width > 0 ? (_width - 1) / 2 : 0));
+	const uint32_t y_padding = MIN(config->outer_padding, (_height > 0 ? (_height - 1) / 2 : 0));
+	if ( x_padding != config->outer_padding || y_padding != config->outer_padding )
+		geometry_interventions++;
+	const struct Rect usable = {
+		.x      = x_padding,
+		.y      = y_padding,
+		.width  = _width - (2 * x_padding),
+		.height = _height - (2 * y_padding),
+	};
+
+#ifndef FIXED_CONFIG
+	struct Layout_cache *cache = get_layout_cache(layout, config, tags, _width, _height, start);
+#else
+	struct Layout_cache *cache = &layout->cache[0];
+#endif
+	if (! reserve_views(&cache->buffer, view_count))
+	{
+		/* Without room for the dimensions, the best we can do is to
+		 * stack all views on top of each other.
+		 */
+#ifndef FIXED_CONFIG
+		cache->generation = 0;
+#endif
+		for (uint32_t i = 0; i < view_count; i++)
+			river_layout_v3_push_view_dimensions(river_layout_v3,
+					(int32_t)usable.x, (int32_t)usable.y,
+					MAX(usable.width, 1), MAX(usable.height, 1), serial);
+		goto commit;
+	}
+	const struct Rect *views = cache->buffer.views;
+
+	if (config->all_primary)
+	{
+		uint32_t i = 0;
+		while ( config->areas[i].next != i + 1 )
+			i++;
+		place_views(cache, config, i, &usable, 0, view_count, &usable);
+		goto push;
+	}
+
+	/* Free space and capacity left in the usable area of the output (first
+	 * slot) and in each area which is divided by child areas.
+	 */
+	struct Rect free_space[MAX_AREAS + 1];
+	uint32_t free_capacity[MAX_AREAS + 1];
+	free_space[0] = usable;
+	free_capacity[0] = UINT32_MAX;
+
+	/* Single pass over the area tree. An area which can hold all remaining
+	 * views, or is the last one of its parent to hold any, takes up all free
+	 * space of its parent, otherwise it is split off of it. Areas which can
+	 * not hold any views are skipped with their entire subtree.
+	 */
+	uint32_t remaining = view_count;
+	for (uint32_t i = 0; i < config->area_count && remaining > 0; )
+	{
+		const struct Area *area = &config->areas[i];
+		if ( area->capacity == 0 )
+		{
+			i = area->next;
+			continue;
+		}
+
+		const size_t slot = (size_t)(area->parent + 1);
+		struct Rect *parent = &free_space[slot];
+		struct Rect rect;
+		if ( area->capacity >= remaining || area->capacity >= free_capacity[slot] )
+			rect = *parent;
+		else
+			split_off_area(parent, &rect, config->inner_padding, area->ratio,
+					area->split_position);
+		free_capacity[slot] -= MIN(area->capacity, free_capacity[slot]);
+
+		if ( area->next == i + 1 )
+		{
+			const uint32_t count = MIN(area->capacity, remaining);
+			place_views(cache, config, i, &rect, view_count - remaining, count, &usable);
+			remaining -= count;
+		}
+		else
+		{
+			free_space[i + 1] = rect;
+			free_capacity[i + 1] = area->capacity;
+		}
+
+		i++;
+	}
+
+push:
+	for (uint32_t i = 0; i < view_count; i++)
+		river_layout_v3_push_view_dimensions(river_layout_v3,
+				(int32_t)views[i].x, (int32_t)views[i].y,
+				views[i].width, views[i].height, serial);
+
+commit:
+	river_layout_v3_commit(layout->river_layout, config->name, serial);
+#if STATE_FILE
+	publish_state(layout, config, tag_config != &layout->namespace->default_layout_config,
+			view_count, _width, _height, tags, serial);
+#endif
+
+#if FLIGHT_RECORDER
+	const struct Flight_event event = {
+		.type = EVENT_DEMAND,
+		.output = layout->output->global_name,
+		.namespace = (uint32_t)(layout->namespace - namespaces),
+		.timestamp = start,
+		.duration = get_time() - start,
+		.demand = {
+			.view_count = view_count,
+			.width = _width,
+			.height = _height,
+			.tags = tags,
+			.serial = serial,
+			.interventions = geometry_interventions,
+		},
+	};
+	flight_recorder_record(&event);
+
+	/* Dumping is deferred to the main loop, so the file is not written
+	 * while handling events.
+	 */
+	if ( flight_recorder.threshold != 0 && event.duration > flight_recorder.threshold )
+		flight_recorder.dump_pending = true;
+#endif
+
+#if PERF_COUNTERS
+	if (counted)
+		add_perf_counters(&layout->output->demand_stats, counters, view_count);
+#endif
+}
+
+static void destroy_layout (struct Layout *layout)
+{
+#ifndef FIXED_CONFIG
+	struct Layout_config *config, *tmp;
+	wl_list_for_each_safe(config, tmp, &layout->layout_configs, link)
+		release_layout_config(config);
+#endif
+
+#if STATE_FILE
+	release_state_slot(layout->state);
+	layout->state = NULL;
+#endif
 
-	if ( output->pending_layout_config.primary_sublayout_status != UNCHANGED )
+	for (size_t i = 0; i < LAYOUT_CACHE_SIZE; i++)
 	{
-		config->primary_sublayout = output->pending_layout_config.primary_sublayout;
-		output->pending_layout_config.primary_sublayout_status = UNCHANGED;
+		free(layout->cache[i].buffer.views);
+		memset(&layout->cache[i], 0, sizeof(struct Layout_cache));
 	}
 
-	if ( output->pending_layout_config.primary_position_status != UNCHANGED )
+	if ( layout->river_layout != NULL )
+		river_layout_v3_destroy(layout->river_layout);
+	layout->river_layout = NULL;
+}
+
+/**
+ * Only the namespace which is already in use is disabled. The others keep
+ * working, unless none are left.
+ */
+static void layout_handle_namespace_in_use (void *data, struct river_layout_v3 *river_layout_v3)
+{
+	struct Layout *layout = (struct Layout *)data;
+	struct Namespace *namespace = layout->namespace;
+	fprintf(stderr, "Namespace already in use: %s\n", namespace->name);
+
+	namespace->disabled = true;
+	const size_t index = (size_t)(namespace - namespaces);
+	struct Output *output;
+	wl_list_for_each(output, &outputs, link)
+		destroy_layout(&output->layouts[index]);
+
+	for (uint32_t i = 0; i < namespace_count; i++)
+		if (! namespaces[i].disabled)
+			return;
+	loop = false;
+}
+
+#ifndef FIXED_CONFIG
+static bool skip_whitespace (const char **ptr)
+{
+	if ( *ptr == NULL )
+		return false;
+	while (isspace((unsigned char)**ptr))
 	{
-		config->primary_position = output->pending_layout_config.primary_position;
-		output->pending_layout_config.primary_position_status = UNCHANGED;
+		(*ptr)++;
+		if ( **ptr == '\0' )
+			return false;
 	}
+	return true;
+}
 
-	if ( output->pending_layout_config.primary_count_status == NEW )
+static bool skip_nonwhitespace (const char **ptr)
+{
+	if ( *ptr == NULL )
+		return false;
+	while (! isspace((unsigned char)**ptr))
 	{
-		config->primary_count = (uint32_t)output->pending_layout_config.primary_count;
-		output->pending_layout_config.primary_count_status = UNCHANGED;
+		(*ptr)++;
+		if ( **ptr == '\0' )
+			return false;
 	}
-	else if ( output->pending_layout_config.primary_count_status == MOD )
+	return true;
+}
+
+static const char *get_second_word (const char **ptr, const char *name)
+{
+	/* Skip to the next word. */
+	if ( !skip_nonwhitespace(ptr) || !skip_whitespace(ptr) )
 	{
-		if ( (int32_t)config->primary_count + output->pending_layout_config.primary_count >= 0 )
-			config->primary_count += (uint32_t)output->pending_layout_config.primary_count;
-		output->pending_layout_config.primary_count_status = UNCHANGED;
+		fprintf(stderr, "ERROR: Too few arguments. '%s' needs one argument.\n", name);
+		return NULL;
 	}
 
-	if ( output->pending_layout_config.primary_ratio_status == NEW )
+	/* Now we know where the second word begins. */
+	const char *second_word = *ptr;
+
+	/* Check if there is a third word. */
+	if ( skip_nonwhitespace(ptr) && skip_whitespace(ptr) )
 	{
-		config->primary_ratio = CLAMP(output->pending_layout_config.primary_ratio, 0.1, 0.9);
-		output->pending_layout_config.primary_ratio_status = UNCHANGED;
+		fprintf(stderr, "ERROR: Too many arguments. '%s' needs one argument.\n", name);
+		return NULL;
 	}
-	else if ( output->pending_layout_config.primary_ratio_status == MOD )
+
+	return second_word;
+}
+
+static enum Layout_value_status layout_value_status_from_word (const char *ptr)
+{
+	if ( *ptr == '+' || *ptr == '-' )
+		return MOD;
+	else
+		return NEW;
+}
+
+/**
+ * Parses the integer at the start of word, which must be followed by
+ * whitespace or the end of the string. Unlike with atoi(), values which do
+ * not fit are rejected.
+ */
+static bool parse_int (const char *word, int32_t *value)
+{
+	char *end;
+	errno = 0;
+	const long result = strtol(word, &end, 10);
+	if ( end == word || errno != 0 || result < INT32_MIN || result > INT32_MAX
+			|| (*end != '\0' && !isspace((unsigned char)*end)) )
+		return false;
+	*value = (int32_t)result;
+	return true;
+}
+
+/** Like parse_int(), but for finite floating point numbers. */
+static bool parse_double (const char *word, double *value)
+{
+	char *end;
+	errno = 0;
+	const double result = strtod(word, &end);
+	if ( end == word || errno != 0 || !isfinite(result)
+			|| (*end != '\0' && !isspace((unsigned char)*end)) )
+		return false;
+	*value = result;
+	return true;
+}
+
+static bool word_comp (const char *word, const char *comp)
+{
+	if ( strncmp(word, comp, strlen(comp)) == 0 )
 	{
-		config->primary_ratio = CLAMP(config->primary_ratio + output->pending_layout_config.primary_ratio, 0.1, 0.9);
-		output->pending_layout_config.primary_ratio_status = UNCHANGED;
+		const char *after_comp = word + strlen(comp);
+		if ( isspace((unsigned char)*after_comp) ||  *after_comp == '\0' )
+			return true;
 	}
+	return false;
+
+}
+
+static bool sublayout_from_string (const char *str, enum Sublayout *sublayout)
+{
+	/* word_comp() is used here to ignore trailing whitespace. */
+	for (uint32_t i = 0; i < sublayout_count; i++)
+		if (word_comp(str, sublayout_names[i]))
+		{
+			*sublayout = (enum Sublayout)i;
+			return true;
+		}
+	fprintf(stderr, "ERROR: Unknown sublayout: %s\n", str);
+	return false;
+}
+
+static bool sublayout_name_is_valid (const char *name)
+{
+	if ( name == NULL || *name == '\0' )
+		return false;
+	for (const char *c = name; *c != '\0'; c++)
+		if (isspace((unsigned char)*c))
+			return false;
+	for (uint32_t i = 0; i < sublayout_count; i++)
+		if (! strcmp(name, sublayout_names[i]))
+			return false;
+	return true;
+}
 
-	if ( output->pending_layout_config.secondary_sublayout_status != UNCHANGED )
+/**
+ * Loads the plugin at path and adds its sublayouts. The plugin is only loaded
+ * if all of its sublayouts can be added.
+ */
+static bool load_plugin (const char *path)
+{
+	const uint32_t first = sublayout_count;
+	void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if ( handle == NULL )
 	{
-		config->secondary_sublayout = output->pending_layout_config.secondary_sublayout;
-		output->pending_layout_config.secondary_sublayout_status = UNCHANGED;
+		fprintf(stderr, "ERROR: dlopen: %s\n", dlerror());
+		return false;
 	}
 
-	if ( output->pending_layout_config.secondary_count_status == NEW )
+	const struct stacktile_plugin *plugin = dlsym(handle, STACKTILE_PLUGIN_SYMBOL);
+	if ( plugin == NULL )
 	{
-		config->secondary_count = (uint32_t)output->pending_layout_config.secondary_count;
-		output->pending_layout_config.secondary_count_status = UNCHANGED;
+		fprintf(stderr, "ERROR: %s: Not a stacktile plugin.\n", path);
+		goto error;
 	}
-	else if ( output->pending_layout_config.secondary_count_status == MOD )
+	if ( plugin->version != STACKTILE_PLUGIN_VERSION )
 	{
-		if ( (int32_t)config->secondary_count + output->pending_layout_config.secondary_count >= 0 )
-			config->secondary_count += (uint32_t)output->pending_layout_config.secondary_count;
-		output->pending_layout_config.secondary_count_status = UNCHANGED;
+		fprintf(stderr, "ERROR: %s: Unsupported plugin version %u, expected %u.\n",
+				path, plugin->version, STACKTILE_PLUGIN_VERSION);
+		goto error;
 	}
-
-	if ( output->pending_layout_config.secondary_ratio_status == NEW )
+	if ( plugin->sublayout_count > MAX_SUBLAYOUTS - sublayout_count )
 	{
-		config->secondary_ratio = CLAMP(output->pending_layout_config.secondary_ratio, 0.1, 0.9);
-		output->pending_layout_config.secondary_ratio_status = UNCHANGED;
+		fprintf(stderr, "ERROR: %s: Too many sublayouts. At most %d sublayouts are supported.\n",
+				path, MAX_SUBLAYOUTS);
+		goto error;
 	}
-	else if ( output->pending_layout_config.secondary_ratio_status == MOD )
+
+	for (uint32_t i = 0; i < plugin->sublayout_count; i++)
 	{
-		config->secondary_ratio = CLAMP(config->secondary_ratio + output->pending_layout_config.secondary_ratio, 0.1, 0.9);
-		output->pending_layout_config.secondary_ratio_status = UNCHANGED;
+		const struct stacktile_sublayout *sublayout = &plugin->sublayouts[i];
+		if ( !sublayout_name_is_valid(sublayout->name) || sublayout->arrange == NULL )
+		{
+			fprintf(stderr, "ERROR: %s: Invalid or duplicate sublayout: %s\n", path,
+					sublayout->name != NULL ? sublayout->name : "(null)");
+			goto error;
+		}
+		sublayout_names[sublayout_count] = sublayout->name;
+		sublayout_plugins[sublayout_count] = sublayout->arrange;
+		sublayout_count++;
 	}
+	return true;
 
-	if ( output->pending_layout_config.remainder_sublayout_status != UNCHANGED )
+error:
+	for (; sublayout_count > first; sublayout_count--)
 	{
-		config->remainder_sublayout = output->pending_layout_config.remainder_sublayout;
-		output->pending_layout_config.remainder_sublayout_status = UNCHANGED;
+		sublayout_names[sublayout_count - 1] = NULL;
+		sublayout_plugins[sublayout_count - 1] = NULL;
 	}
+	dlclose(handle);
+	return false;
+}
 
-	if ( output->pending_layout_config.inner_padding_status == NEW )
+static bool position_from_string (const char *str, enum Position *position )
+{
+	/* word_comp() is used here to ignore trailing whitespace. */
+	if (word_comp(str, "top"))
+		*position = TOP;
+	else if (word_comp(str, "right"))
+		*position = RIGHT;
+	else if (word_comp(str, "bottom"))
+		*position = BOTTOM;
+	else if (word_comp(str, "left"))
+		*position = LEFT;
+	else if (word_comp(str, "auto"))
+		*position = AUTO;
+	else
 	{
-		config->inner_padding = (uint32_t)output->pending_layout_config.inner_padding;
-		output->pending_layout_config.inner_padding_status = UNCHANGED;
+		fprintf(stderr, "ERROR: Unknown position: %s\n", str);
+		return false;
 	}
-	else if ( output->pending_layout_config.inner_padding_status == MOD )
+	return true;
+}
+
+/** Like get_second_word(), but for commands taking an area and a value. */
+static bool get_area_arguments (const char **ptr, const char *name, uint32_t *area,
+		const char **value)
+{
+	if ( !skip_nonwhitespace(ptr) || !skip_whitespace(ptr) )
 	{
-		if ( (int32_t)config->inner_padding + output->pending_layout_config.inner_padding >= 0 )
-			config->inner_padding += (uint32_t)output->pending_layout_config.inner_padding;
-		output->pending_layout_config.inner_padding_status = UNCHANGED;
+		fprintf(stderr, "ERROR: Too few arguments. '%s' needs two arguments.\n", name);
+		return false;
 	}
 
-	if ( output->pending_layout_config.outer_padding_status == NEW )
+	int32_t index;
+	if ( !parse_int(*ptr, &index) || index < 1 || index > MAX_AREAS )
 	{
-		config->outer_padding = (uint32_t)output->pending_layout_config.outer_padding;
-		output->pending_layout_config.outer_padding_status = UNCHANGED;
+		fprintf(stderr, "ERROR: Invalid area: %s\n", *ptr);
+		return false;
 	}
-	else if ( output->pending_layout_config.outer_padding_status == MOD )
+	*area = (uint32_t)index - 1;
+
+	*value = get_second_word(ptr, name);
+	return *value != NULL;
+}
+
+/**
+ * Copies the first word of str to name, which has room for PRESET_NAME_SIZE
+ * bytes. Returns false if it is no valid preset name.
+ */
+static bool get_preset_name (char *name, const char *str)
+{
+	size_t len = 0;
+	while ( str[len] != '\0' && !isspace((unsigned char)str[len]) )
+		len++;
+	if ( len == 0 || len >= PRESET_NAME_SIZE )
 	{
-		if ( (int32_t)config->outer_padding + output->pending_layout_config.outer_padding >= 0 )
-			config->outer_padding += (uint32_t)output->pending_layout_config.outer_padding;
-		output->pending_layout_config.outer_padding_status = UNCHANGED;
+		fprintf(stderr, "ERROR: Invalid preset name: %s\n", str);
+		return false;
 	}
+	memcpy(name, str, len);
+	name[len] = '\0';
+	return true;
+}
 
-	if ( output->pending_layout_config.all_primary_status == NEW )
+static void queue_change (struct Layout *layout, const struct Pending_change *change)
+{
+	if ( layout->pending_change_count == MAX_PENDING_CHANGES )
 	{
-		config->all_primary = output->pending_layout_config.all_primary;
-		output->pending_layout_config.all_primary_status = UNCHANGED;
+		fprintf(stderr, "ERROR: Too many pending changes. At most %d changes are supported "
+				"between layout demands.\n", MAX_PENDING_CHANGES);
+		return;
 	}
-	else if ( output->pending_layout_config.all_primary_status == MOD )
+	layout->pending_changes[layout->pending_change_count++] = *change;
+}
+
+/**
+ * Applies the pending changes of all layouts of the namespace to the tag sets
+ * of their last layout demands, which they most likely are meant for. This
+ * keeps them in order with a change which is applied right away.
+ */
+static void flush_pending_changes (struct Namespace *namespace)
+{
+	const size_t index = (size_t)(namespace - namespaces);
+	struct Output *output;
+	wl_list_for_each(output, &outputs, link)
 	{
-		config->all_primary = !config->all_primary;
-		output->pending_layout_config.all_primary_status = UNCHANGED;
+		struct Layout *layout = &output->layouts[index];
+		if ( layout->demanded && has_pending_changes(layout) )
+			get_layout_config(layout, layout->tags);
 	}
+}
 
-	return config;
+/** Applies a change sent to the layout to each config of the list. */
+static void apply_change_to_configs (struct Layout *layout, struct wl_list *configs,
+		const struct Pending_change *change)
+{
+	struct Layout_config *config;
+	wl_list_for_each(config, configs, link)
+		apply_changes(layout, config, change, 1, false);
 }
 
-static void layout_handle_layout_demand (void *data, struct river_layout_v3 *river_layout_v3,
-		uint32_t view_count, uint32_t _width, uint32_t _height, uint32_t tags, uint32_t serial)
+/**
+ * Adds a change to the configs in the scope. Changes to the tag sets of the
+ * next layout demands are queued, all others are applied right away. Either
+ * way, outputs are only laid out again on their next layout demand.
+ *
+ * Without per tag set configs, all outputs use the default config, so a change
+ * for all outputs is only queued once. Otherwise each output applies it to a
+ * config of its own. Changes to all outputs and tag sets also apply to the
+ * configs kept for disconnected outputs.
+ */
+static void add_pending_change (struct Layout *layout, enum Command_scope scope,
+		const struct Pending_change *change)
 {
-	struct Output *output = (struct Output *)data;
-	struct Layout_config *config = get_layout_config(output, tags);
+	struct Namespace *namespace = layout->namespace;
+	const size_t index = (size_t)(namespace - namespaces);
+	struct Output *output;
 
-	uint32_t width  = _width - (2 * config->outer_padding);
-	uint32_t height = _height - (2 * config->outer_padding);
-	uint32_t x      = config->inner_padding;
-	uint32_t y      = config->inner_padding;
+	if ( scope != SCOPE_FOCUSED && scope != SCOPE_OUTPUTS )
+		flush_pending_changes(namespace);
 
-	/* Primary. */
-	if ( config->primary_count >= view_count || config->all_primary )
-	{
-		do_sublayout(river_layout_v3, serial, x, y, width, height,
-				view_count, config->inner_padding, config->primary_sublayout);
-		goto commit;
-	}
-	else if ( config->primary_count != 0 )
+	switch (scope)
 	{
-		uint32_t primary_x, primary_y, primary_width, primary_height;
-		split_off_area(&x, &y, &width, &height,
-				&primary_x, &primary_y, &primary_width, &primary_height,
-				config->inner_padding, config->primary_ratio,
-				config->primary_position);
-		do_sublayout(river_layout_v3, serial,
-				primary_x, primary_y, primary_width, primary_height,
-				config->primary_count, config->inner_padding,
-				config->primary_sublayout);
-	}
+		case SCOPE_FOCUSED:
+			queue_change(layout, change);
+			break;
 
-	/* Secondary. */
-	if ( config->secondary_count >= view_count - config->primary_count )
-	{
-		do_sublayout(river_layout_v3, serial, x, y, width, height,
-				view_count - config->primary_count,
-				config->inner_padding, config->secondary_sublayout);
-		goto commit;
-	}
-	else if ( config->secondary_count != 0 )
-	{
-		uint32_t secondary_x, secondary_y, secondary_width, secondary_height;
-		const enum Position secondary_position =
-				(config->primary_position == LEFT || config->primary_position == RIGHT) ? TOP : LEFT;
-		split_off_area(&x, &y, &width, &height,
-				&secondary_x, &secondary_y, &secondary_width, &secondary_height,
-				config->inner_padding, config->secondary_ratio,
-				secondary_position);
-		do_sublayout(river_layout_v3, serial,
-				secondary_x, secondary_y, secondary_width, secondary_height,
-				config->secondary_count, config->inner_padding,
-				config->secondary_sublayout);
-	}
+		case SCOPE_OUTPUTS:
+			if (! namespace->per_tag_config)
+				queue_change(layout, change);
+			else
+				wl_list_for_each(output, &outputs, link)
+					queue_change(&output->layouts[index], change);
+			break;
 
-	/* Remainder. */
-	const uint32_t remainder_count = view_count - (config->primary_count + config->secondary_count);
-	if ( remainder_count > 0 )
-		do_sublayout(river_layout_v3, serial, x, y, width, height, remainder_count,
-				config->inner_padding, config->remainder_sublayout);
+		case SCOPE_TAGS:
+			apply_change_to_configs(layout, &layout->layout_configs, change);
+			apply_changes(layout, &namespace->default_layout_config, change, 1, false);
+			break;
 
-commit:
-	// TODO useful layout name
-	river_layout_v3_commit(output->layout, "stacktile", serial);
+		case SCOPE_ALL:
+			wl_list_for_each(output, &outputs, link)
+				apply_change_to_configs(layout, &output->layouts[index].layout_configs,
+						change);
+			for (size_t i = 0; i < MAX_RETAINED_OUTPUTS; i++)
+				apply_change_to_configs(layout, &retained_outputs[i].layout_configs[index],
+						change);
+			apply_changes(layout, &namespace->default_layout_config, change, 1, false);
+			break;
+
+		case SCOPE_DEFAULT:
+			apply_changes(layout, &namespace->default_layout_config, change, 1, false);
+			break;
+	}
 }
 
-static void layout_handle_namespace_in_use (void *data, struct river_layout_v3 *river_layout_v3)
+/**
+ * Returns whether the given amount of changes can be added in the scope, so
+ * that a command either takes effect entirely or not at all.
+ */
+static bool can_add_pending_changes (struct Layout *layout, enum Command_scope scope,
+		uint32_t count)
 {
-	fputs("Namespace already in use.\n", stderr);
-	loop = false;
+	const size_t index = (size_t)(layout->namespace - namespaces);
+	struct Output *output;
+	bool fits = true;
+
+	if ( scope == SCOPE_FOCUSED || ( scope == SCOPE_OUTPUTS && !layout->namespace->per_tag_config ) )
+		fits = layout->pending_change_count + count <= MAX_PENDING_CHANGES;
+	else if ( scope == SCOPE_OUTPUTS )
+		wl_list_for_each(output, &outputs, link)
+			if ( output->layouts[index].pending_change_count + count > MAX_PENDING_CHANGES )
+				fits = false;
+
+	if (! fits)
+		fprintf(stderr, "ERROR: Too many pending changes. At most %d changes are supported "
+				"between layout demands.\n", MAX_PENDING_CHANGES);
+	return fits;
 }
 
-static bool skip_whitespace (char **ptr)
+/** Deletes the configs of all tag sets of the layout, including pending changes. */
+static void reset_tag_sets (struct Layout *layout)
 {
-	if ( *ptr == NULL )
-		return false;
-	while (isspace(**ptr))
-	{
-		(*ptr)++;
-		if ( **ptr == '\0' )
-			return false;
-	}
-	return true;
+	struct Layout_config *config, *tmp;
+	wl_list_for_each_safe(config, tmp, &layout->layout_configs, link)
+		release_layout_config(config);
+	layout->pending_change_count = 0;
 }
 
-static bool skip_nonwhitespace (char **ptr)
+/**
+ * Returns the configs in the scope to the values given by the options. Tag
+ * sets lose their own configs, the default config is restored.
+ */
+static void reset_layout_configs (struct Layout *layout, enum Command_scope scope)
 {
-	if ( *ptr == NULL )
-		return false;
-	while (! isspace(**ptr))
+	struct Namespace *namespace = layout->namespace;
+	const size_t index = (size_t)(namespace - namespaces);
+	struct Output *output;
+	struct Layout_config *config, *tmp;
+
+	if ( scope != SCOPE_FOCUSED && scope != SCOPE_OUTPUTS )
+		flush_pending_changes(namespace);
+
+	switch (scope)
 	{
-		(*ptr)++;
-		if ( **ptr == '\0' )
-			return false;
+		case SCOPE_FOCUSED:
+		case SCOPE_TAGS:
+			reset_tag_sets(layout);
+			break;
+
+		case SCOPE_OUTPUTS:
+		case SCOPE_ALL:
+			wl_list_for_each(output, &outputs, link)
+				reset_tag_sets(&output->layouts[index]);
+			for (size_t i = 0; i < MAX_RETAINED_OUTPUTS; i++)
+				wl_list_for_each_safe(config, tmp, &retained_outputs[i].layout_configs[index], link)
+					release_layout_config(config);
+			break;
+
+		case SCOPE_DEFAULT:
+			break;
 	}
-	return true;
+
+	if ( scope == SCOPE_TAGS || scope == SCOPE_ALL || scope == SCOPE_DEFAULT )
+		namespace->default_layout_config = namespace->initial_layout_config;
 }
 
-static const char *get_second_word (char **ptr, const char *name)
+/** Parses the value of a change. Returns false if it is invalid. */
+static bool parse_change (struct Pending_change *change, enum Change_type type,
+		uint32_t area, const char *value)
 {
-	/* Skip to the next word. */
-	if ( !skip_nonwhitespace(ptr) || !skip_whitespace(ptr) )
+	*change = (struct Pending_change){
+		.type   = type,
+		.status = NEW,
+		.area   = area,
+	};
+	switch (type)
 	{
-		fprintf(stderr, "ERROR: Too few arguments. '%s' needs one argument.\n", name);
-		return NULL;
-	}
+		case CHANGE_AREA_COUNT:
+		case CHANGE_INNER_PADDING:
+		case CHANGE_OUTER_PADDING:
+			if (! parse_int(value, &change->integer))
+			{
+				fprintf(stderr, "ERROR: Invalid number: %s\n", value);
+				return false;
+			}
+			change->status = layout_value_status_from_word(value);
+			break;
 
-	/* Now we know where the second word begins. */
-	const char *second_word = *ptr;
+		case CHANGE_AREA_RATIO:
+			if (! parse_double(value, &change->ratio))
+			{
+				fprintf(stderr, "ERROR: Invalid number: %s\n", value);
+				return false;
+			}
+			change->status = layout_value_status_from_word(value);
+			break;
 
-	/* Check if there is a third word. */
-	if ( skip_nonwhitespace(ptr) && skip_whitespace(ptr) )
-	{
-		fprintf(stderr, "ERROR: Too many arguments. '%s' needs one argument.\n", name);
-		return NULL;
-	}
+		case CHANGE_AREA_SUBLAYOUT:
+		case CHANGE_REMAINDER_SUBLAYOUT:
+			if (! sublayout_from_string(value, &change->sublayout))
+				return false;
+			break;
 
-	return second_word;
+		case CHANGE_AREA_POSITION:
+			if (! position_from_string(value, &change->position))
+				return false;
+			break;
+
+		case CHANGE_ALL_PRIMARY:
+			if (word_comp(value, "true"))
+				change->all_primary = true;
+			else if (word_comp(value, "false"))
+				change->all_primary = false;
+			else if (word_comp(value, "toggle"))
+				change->status = MOD;
+			else
+			{
+				fprintf(stderr, "ERROR: Invalid argument: %s\n", value);
+				return false;
+			}
+			break;
+
+		case CHANGE_PRESET:
+		case CHANGE_SAVE_PRESET:
+			if (! get_preset_name(change->preset, value))
+				return false;
+			break;
+	}
+	return true;
 }
 
-static enum Layout_value_status layout_value_status_from_word (const char *ptr)
+static void set_pending_value (struct Layout *layout, enum Command_scope scope,
+		enum Change_type type, uint32_t area, const char *value)
 {
-	if ( *ptr == '+' || *ptr == '-' )
-		return MOD;
-	else
-		return NEW;
+	struct Pending_change change;
+	if ( parse_change(&change, type, area, value) )
+		add_pending_change(layout, scope, &change);
 }
 
-static bool word_comp (const char *word, const char *comp)
+/**
+ * Parses an area in the format count:ratio:position:sublayout[:parent] and
+ * appends it to the area tree of the config. Parents are given as one-based
+ * index, zero being the usable area of the output.
+ */
+static bool add_area_from_string (struct Layout_config *config, const char *str)
 {
-	if ( strncmp(word, comp, strlen(comp)) == 0 )
+	if ( config->area_count == MAX_AREAS )
 	{
-		const char *after_comp = word + strlen(comp);
-		if ( isspace(*after_comp) ||  *after_comp == '\0' )
-			return true;
+		fprintf(stderr, "ERROR: Too many areas. At most %d areas are supported.\n", MAX_AREAS);
+		return false;
 	}
-	return false;
 
-}
+	char buffer[128];
+	if ( strlen(str) >= sizeof(buffer) )
+	{
+		fprintf(stderr, "ERROR: Invalid area: %s\n", str);
+		return false;
+	}
+	strcpy(buffer, str);
 
-static bool sublayout_from_string (const char *str, enum Sublayout *sublayout)
-{
-	/* word_comp() is used here to ignore trailing whitespace. */
-	if (word_comp(str, "columns"))
-		*sublayout = COLUMNS;
-	else if (word_comp(str, "rows"))
-		*sublayout = ROWS;
-	else if (word_comp(str, "stack"))
-		*sublayout = STACK;
-	else if (word_comp(str, "grid"))
-		*sublayout = GRID;
-	else if (word_comp(str, "full"))
-		*sublayout = FULL;
-	else
+	/* Unlike with strtok(), empty fields are kept, so they are rejected
+	 * below instead of shifting the following fields.
+	 */
+	char *fields[5] = { 0 };
+	size_t field_count = 0;
+	char *field = buffer;
+	while ( field != NULL && field_count < 5 )
+	{
+		fields[field_count++] = field;
+		field = strchr(field, ':');
+		if ( field != NULL )
+			*field++ = '\0';
+	}
+
+	int32_t count, parent = 0;
+	double ratio;
+	if ( field != NULL || field_count < 4 || !parse_int(fields[0], &count)
+			|| !parse_double(fields[1], &ratio)
+			|| ( fields[4] != NULL && !parse_int(fields[4], &parent) ) )
+	{
+		fprintf(stderr, "ERROR: Invalid area: %s\n", str);
+		return false;
+	}
+
+	struct Area *area = &config->areas[config->area_count];
+	if ( count < 0 )
+	{
+		fputs("ERROR: Area count may not be negative.\n", stderr);
+		return false;
+	}
+	if ( parent < 0 || !area_parent_is_valid(config, parent - 1) )
 	{
-		fprintf(stderr, "ERROR: Unknown sublayout: %s\n", str);
+		fprintf(stderr, "ERROR: Invalid parent area: %s\n", fields[4]);
 		return false;
 	}
+	if ( !position_from_string(fields[2], &area->position)
+			|| !sublayout_from_string(fields[3], &area->sublayout) )
+		return false;
+
+	area->parent = parent - 1;
+	area->count  = (uint32_t)count;
+	area->ratio  = CLAMP(ratio, 0.1, 0.9);
+	config->area_count++;
 	return true;
 }
 
-static bool position_from_string (const char *str, enum Position *position )
+static bool scope_from_string (const char *str, enum Command_scope *scope)
 {
 	/* word_comp() is used here to ignore trailing whitespace. */
-	if (word_comp(str, "top"))
-		*position = TOP;
-	else if (word_comp(str, "right"))
-		*position = RIGHT;
-	else if (word_comp(str, "bottom"))
-		*position = BOTTOM;
-	else if (word_comp(str, "left"))
-		*position = LEFT;
+	if (word_comp(str, "all_outputs"))
+		*scope = SCOPE_OUTPUTS;
+	else if (word_comp(str, "all_tags"))
+		*scope = SCOPE_TAGS;
+	else if (word_comp(str, "all"))
+		*scope = SCOPE_ALL;
+	else if (word_comp(str, "default"))
+		*scope = SCOPE_DEFAULT;
 	else
-	{
-		fprintf(stderr, "ERROR: Unknown position: %s\n", str);
 		return false;
-	}
 	return true;
 }
 
-static void layout_handle_user_command (void *data, struct river_layout_v3 *river_layout_manager_v3,
-		const char *_command)
+static void handle_user_command (struct Layout *layout, const char *command)
 {
-	struct Output *output = (struct Output *)data;
+	/* Commands are short, so longer strings can be rejected right away. This
+	 * bounds the time spent scanning them.
+	 */
+	if ( strnlen(command, MAX_COMMAND_LENGTH + 1) > MAX_COMMAND_LENGTH )
+	{
+		fprintf(stderr, "ERROR: Command too long. At most %d characters are supported.\n",
+				MAX_COMMAND_LENGTH);
+		return;
+	}
 
 	/* Skip preceding whitespace. */
-	char *command = (char *)_command;
 	if (! skip_whitespace(&command))
 		return;
 
+	/* The command may be preceded by its scope. */
+	enum Command_scope scope = SCOPE_FOCUSED;
+	if ( scope_from_string(command, &scope)
+			&& (!skip_nonwhitespace(&command) || !skip_whitespace(&command)) )
+	{
+		fputs("ERROR: Too few arguments. A scope needs to be followed by a command.\n", stderr);
+		return;
+	}
+
 	if (word_comp(command, "primary_count"))
 	{
 		const char *second_word = get_second_word(&command, "primary_count");
 		if ( second_word == NULL )
 			return;
-		output->pending_layout_config.primary_count = atoi(second_word);
-		output->pending_layout_config.primary_count_status = layout_value_status_from_word(second_word);
+		set_pending_value(layout, scope, CHANGE_AREA_COUNT, 0, second_word);
 	}
 	else if (word_comp(command, "primary_ratio"))
 	{
 		const char *second_word = get_second_word(&command, "primary_ratio");
 		if ( second_word == NULL )
 			return;
-		output->pending_layout_config.primary_ratio = atof(second_word);
-		output->pending_layout_config.primary_ratio_status = layout_value_status_from_word(second_word);
+		set_pending_value(layout, scope, CHANGE_AREA_RATIO, 0, second_word);
 	}
 	else if (word_comp(command, "primary_sublayout"))
 	{
 		const char *second_word = get_second_word(&command, "primary_sublayout");
 		if ( second_word == NULL )
 			return;
-		if (! sublayout_from_string(second_word, &output->pending_layout_config.primary_sublayout))
-			return;
-		output->pending_layout_config.primary_sublayout_status = NEW;
+		set_pending_value(layout, scope, CHANGE_AREA_SUBLAYOUT, 0, second_word);
 	}
 	else if (word_comp(command, "primary_position"))
 	{
 		const char *second_word = get_second_word(&command, "primary_position");
 		if ( second_word == NULL )
 			return;
-		if (! position_from_string(second_word, &output->pending_layout_config.primary_position))
-			return;
-		output->pending_layout_config.primary_position_status = NEW;
+		set_pending_value(layout, scope, CHANGE_AREA_POSITION, 0, second_word);
 	}
 	else if (word_comp(command, "secondary_count"))
 	{
 		const char *second_word = get_second_word(&command, "secondary_count");
 		if ( second_word == NULL )
 			return;
-		output->pending_layout_config.secondary_count = atoi(second_word);
-		output->pending_layout_config.secondary_count_status = layout_value_status_from_word(second_word);
+		set_pending_value(layout, scope, CHANGE_AREA_COUNT, 1, second_word);
 	}
 	else if (word_comp(command, "secondary_ratio"))
 	{
 		const char *second_word = get_second_word(&command, "secondary_ratio");
 		if ( second_word == NULL )
 			return;
-		output->pending_layout_config.secondary_ratio = atof(second_word);
-		output->pending_layout_config.secondary_ratio_status = layout_value_status_from_word(second_word);
+		set_pending_value(layout, scope, CHANGE_AREA_RATIO, 1, second_word);
 	}
 	else if (word_comp(command, "secondary_sublayout"))
 	{
 		const char *second_word = get_second_word(&command, "secondary_sublayout");
 		if ( second_word == NULL )
 			return;
-		if (! sublayout_from_string(second_word, &output->pending_layout_config.secondary_sublayout))
-			return;
-		output->pending_layout_config.secondary_sublayout_status = NEW;
+		set_pending_value(layout, scope, CHANGE_AREA_SUBLAYOUT, 1, second_word);
 	}
 	else if (word_comp(command, "remainder_sublayout"))
 	{
 		const char *second_word = get_second_word(&command, "remainder_sublayout");
 		if ( second_word == NULL )
 			return;
-		if (! sublayout_from_string(second_word, &output->pending_layout_config.remainder_sublayout))
+		set_pending_value(layout, scope, CHANGE_REMAINDER_SUBLAYOUT, 0, second_word);
+	}
+	else if (word_comp(command, "area_count"))
+	{
+		const char *value;
+		uint32_t area;
+		if (! get_area_arguments(&command, "area_count", &area, &value))
+			return;
+		set_pending_value(layout, scope, CHANGE_AREA_COUNT, area, value);
+	}
+	else if (word_comp(command, "area_ratio"))
+	{
+		const char *value;
+		uint32_t area;
+		if (! get_area_arguments(&command, "area_ratio", &area, &value))
+			return;
+		set_pending_value(layout, scope, CHANGE_AREA_RATIO, area, value);
+	}
+	else if (word_comp(command, "area_sublayout"))
+	{
+		const char *value;
+		uint32_t area;
+		if (! get_area_arguments(&command, "area_sublayout", &area, &value))
+			return;
+		set_pending_value(layout, scope, CHANGE_AREA_SUBLAYOUT, area, value);
+	}
+	else if (word_comp(command, "area_position"))
+	{
+		const char *value;
+		uint32_t area;
+		if (! get_area_arguments(&command, "area_position", &area, &value))
 			return;
-		output->pending_layout_config.remainder_sublayout_status = NEW;
+		set_pending_value(layout, scope, CHANGE_AREA_POSITION, area, value);
 	}
 	else if (word_comp(command, "inner_padding"))
 	{
 		const char *second_word = get_second_word(&command, "inner_padding");
 		if ( second_word == NULL )
 			return;
-		output->pending_layout_config.inner_padding = atoi(second_word);
-		output->pending_layout_config.inner_padding_status = layout_value_status_from_word(second_word);
+		set_pending_value(layout, scope, CHANGE_INNER_PADDING, 0, second_word);
 	}
 	else if (word_comp(command, "outer_padding"))
 	{
 		const char *second_word = get_second_word(&command, "outer_padding");
 		if ( second_word == NULL )
 			return;
-		output->pending_layout_config.outer_padding = atoi(second_word);
-		output->pending_layout_config.outer_padding_status = layout_value_status_from_word(second_word);
+		set_pending_value(layout, scope, CHANGE_OUTER_PADDING, 0, second_word);
 	}
 	else if (word_comp(command, "all_padding"))
 	{
 		const char *second_word = get_second_word(&command, "all_padding");
 		if ( second_word == NULL )
 			return;
-		const int32_t arg = atoi(second_word);
-		const  enum Layout_value_status status = layout_value_status_from_word(second_word);
-		output->pending_layout_config.outer_padding = arg;
-		output->pending_layout_config.outer_padding_status = status;
-		output->pending_layout_config.inner_padding = arg;
-		output->pending_layout_config.inner_padding_status = status;
+		struct Pending_change outer, inner;
+		if ( !parse_change(&outer, CHANGE_OUTER_PADDING, 0, second_word)
+				|| !can_add_pending_changes(layout, scope, 2) )
+			return;
+		inner = outer;
+		inner.type = CHANGE_INNER_PADDING;
+		add_pending_change(layout, scope, &outer);
+		add_pending_change(layout, scope, &inner);
 	}
 	else if (word_comp(command, "all_primary"))
 	{
-		const char *second_word = get_second_word(&command, "sublayout");
+		const char *second_word = get_second_word(&command, "all_primary");
 		if ( second_word == NULL )
 			return;
-		if (word_comp(second_word, "true"))
-		{
-			output->pending_layout_config.all_primary = true;
-			output->pending_layout_config.all_primary_status = NEW;
-		}
-		else if (word_comp(second_word, "false"))
+		set_pending_value(layout, scope, CHANGE_ALL_PRIMARY, 0, second_word);
+	}
+	else if (word_comp(command, "preset"))
+	{
+		const char *second_word = get_second_word(&command, "preset");
+		if ( second_word == NULL )
+			return;
+		set_pending_value(layout, scope, CHANGE_PRESET, 0, second_word);
+	}
+	else if (word_comp(command, "save_preset"))
+	{
+		const char *second_word = get_second_word(&command, "save_preset");
+		if ( second_word == NULL )
+			return;
+		set_pending_value(layout, scope, CHANGE_SAVE_PRESET, 0, second_word);
+	}
+	else if (word_comp(command, "load_plugin"))
+	{
+		const char *second_word = get_second_word(&command, "load_plugin");
+		if ( second_word == NULL )
+			return;
+		char path[PATH_MAX];
+		const size_t len = strcspn(second_word, " \t\n\v\f\r");
+		if ( len >= sizeof(path) )
 		{
-			output->pending_layout_config.all_primary = false;
-			output->pending_layout_config.all_primary_status = NEW;
+			fprintf(stderr, "ERROR: Path too long: %s\n", second_word);
+			return;
 		}
-		else if (word_comp(second_word, "toggle"))
-			output->pending_layout_config.all_primary_status = MOD;
-		else
-			fprintf(stderr, "ERROR: Invalid argument: %s\n", command);
+		memcpy(path, second_word, len);
+		path[len] = '\0';
+		load_plugin(path);
 	}
 	else if (word_comp(command, "reset"))
 	{
@@ -777,18 +2962,42 @@ static void layout_handle_user_command (void *data, struct river_layout_v3 *rive
 			fputs("ERROR: Too many arguments. 'reset' has no arguments.\n", stderr);
 			return;
 		}
-
-		struct Layout_config *config, *tmp;
-		wl_list_for_each_safe(config, tmp, &output->layout_configs, link)
-		{
-			wl_list_remove(&config->link);
-			free(config);
-		}
+		reset_layout_configs(layout, scope);
 	}
 	else
 		fprintf(stderr, "ERROR: Unknown command: %s\n", command);
 }
 
+static void layout_handle_user_command (void *data, struct river_layout_v3 *river_layout_manager_v3,
+		const char *command)
+{
+	struct Layout *layout = (struct Layout *)data;
+	uint64_t counters[PERF_COUNTER_COUNT];
+	const bool counted = perf_counters.enabled && read_perf_counters(counters);
+	struct Flight_event event = {
+		.type = EVENT_COMMAND,
+		.output = layout->output->global_name,
+		.namespace = (uint32_t)(layout->namespace - namespaces),
+		.timestamp = get_time(),
+	};
+
+	handle_user_command(layout, command);
+
+	event.duration = get_time() - event.timestamp;
+	strncpy(event.command, command, sizeof(event.command) - 1);
+	flight_recorder_record(&event);
+
+	if (counted)
+		add_perf_counters(&layout->output->command_stats, counters, 0);
+}
+#else
+static void layout_handle_user_command (void *data, struct river_layout_v3 *river_layout_manager_v3,
+		const char *command)
+{
+	fprintf(stderr, "ERROR: The layout of this build is fixed, ignoring command: %s\n", command);
+}
+#endif
+
 static const struct river_layout_v3_listener layout_listener = {
 	.namespace_in_use = layout_handle_namespace_in_use,
 	.layout_demand    = layout_handle_layout_demand,
@@ -798,12 +3007,64 @@ static const struct river_layout_v3_listener layout_listener = {
 static void configure_output (struct Output *output)
 {
 	output->configured = true;
-	output->layout = river_layout_manager_v3_get_layout(layout_manager,
-			output->output, "stacktile");
-	river_layout_v3_add_listener(output->layout, &layout_listener, output);
+	for (uint32_t i = 0; i < namespace_count; i++)
+	{
+		struct Layout *layout = &output->layouts[i];
+		if (layout->namespace->disabled)
+			continue;
+		layout->river_layout = river_layout_manager_v3_get_layout(layout_manager,
+				output->output, layout->namespace->name);
+		river_layout_v3_add_listener(layout->river_layout, &layout_listener, layout);
+	}
+
+	/* Sent right away instead of after all pending events are handled. */
+	if ( wl_display_flush(wl_display) == -1 && errno != EAGAIN )
+		fprintf(stderr, "WARNING: wl_display_flush: %s\n", strerror(errno));
+}
+
+#ifndef FIXED_CONFIG
+static void noop () {}
+
+static void output_handle_name (void *data, struct wl_output *wl_output,
+		const char *name)
+{
+	struct Output *output = (struct Output *)data;
+	snprintf(output->identity, sizeof(output->identity), "%s", name);
+	output->identity_is_name = true;
+}
+
+static void output_handle_description (void *data, struct wl_output *wl_output,
+		const char *description)
+{
+	struct Output *output = (struct Output *)data;
+	if (! output->identity_is_name)
+		snprintf(output->identity, sizeof(output->identity), "%s", description);
+}
+
+/**
+ * The name and description of the output are sent before the first done
+ * event, which in turn is sent before the first layout demand.
+ */
+static void output_handle_done (void *data, struct wl_output *wl_output)
+{
+	struct Output *output = (struct Output *)data;
+	if ( output->restored || output->identity[0] == '\0' )
+		return;
+	output->restored = true;
+	restore_layout_configs(output);
 }
 
-static bool create_output (struct wl_output *wl_output)
+static const struct wl_output_listener output_listener = {
+	.geometry    = noop,
+	.mode        = noop,
+	.done        = output_handle_done,
+	.scale       = noop,
+	.name        = output_handle_name,
+	.description = output_handle_description,
+};
+#endif
+
+static bool create_output (struct wl_output *wl_output, uint32_t global_name)
 {
 	struct Output *output = calloc(1, sizeof(struct Output));
 	if ( output == NULL )
@@ -812,30 +3073,66 @@ static bool create_output (struct wl_output *wl_output)
 		return false;
 	}
 
-	output->output     = wl_output;
-	output->layout     = NULL;
-	output->configured = false;
+	output->output      = wl_output;
+	output->global_name = global_name;
+	output->configured  = false;
+
+	for (uint32_t i = 0; i < namespace_count; i++)
+	{
+		struct Layout *layout = &output->layouts[i];
+		layout->output       = output;
+		layout->namespace    = &namespaces[i];
+		layout->river_layout = NULL;
+#if STATE_FILE
+		layout->state        = acquire_state_slot(global_name, namespaces[i].name);
+#endif
+#ifndef FIXED_CONFIG
+		wl_list_init(&layout->layout_configs);
+#endif
+	}
 
-	wl_list_init(&output->layout_configs);
+#ifndef FIXED_CONFIG
+	wl_output_add_listener(wl_output, &output_listener, output);
+#endif
 
+	/* The layouts are requested before allocating anything else, so the
+	 * compositor can already demand them.
+	 */
 	if ( layout_manager != NULL )
 		configure_output(output);
 
+	/* Room for the views of typical layout demands is allocated up front. */
+	const uint32_t capacity = latency_critical.enabled ?
+			LATENCY_CRITICAL_VIEW_CAPACITY : INITIAL_VIEW_CAPACITY;
+	for (uint32_t i = 0; i < namespace_count; i++)
+		for (size_t j = 0; j < LAYOUT_CACHE_SIZE; j++)
+		{
+			struct View_buffer *buffer = &output->layouts[i].cache[j].buffer;
+			if (! reserve_views(buffer, capacity))
+			{
+				for (uint32_t k = 0; k < namespace_count; k++)
+					destroy_layout(&output->layouts[k]);
+				free(output);
+				return false;
+			}
+#if LATENCY_CRITICAL
+			if (latency_critical.enabled)
+				prefault(buffer->views, buffer->capacity * sizeof(struct Rect));
+#endif
+		}
+#if LATENCY_CRITICAL
+	if (latency_critical.enabled)
+		prefault(output, sizeof(struct Output));
+#endif
+
 	wl_list_insert(&outputs, &output->link);
 	return true;
 }
 
 static void destroy_output (struct Output *output)
 {
-	struct Layout_config *config, *tmp;
-	wl_list_for_each_safe(config, tmp, &output->layout_configs, link)
-	{
-		wl_list_remove(&config->link);
-		free(config);
-	}
-
-	if ( output->layout != NULL )
-		river_layout_v3_destroy(output->layout);
+	for (uint32_t i = 0; i < namespace_count; i++)
+		destroy_layout(&output->layouts[i]);
 	wl_output_destroy(output->output);
 	wl_list_remove(&output->link);
 	free(output);
@@ -852,13 +3149,24 @@ static void registry_handle_global (void *data, struct wl_registry *registry,
 		uint32_t name, const char *interface, uint32_t version)
 {
 	if (! strcmp(interface, river_layout_manager_v3_interface.name))
+	{
 		layout_manager = wl_registry_bind(registry, name,
 				&river_layout_manager_v3_interface, 1);
+
+		/* Outputs announced before the layout manager get their layouts
+		 * now, not only once the initial roundtrip is done.
+		 */
+		struct Output *output;
+		wl_list_for_each(output, &outputs, link)
+			if (! output->configured)
+				configure_output(output);
+	}
 	else if (! strcmp(interface, wl_output_interface.name))
 	{
+		/* Version 4 adds the name and description events. */
 		struct wl_output *wl_output = wl_registry_bind(registry, name,
-				&wl_output_interface, version);
-		if (! create_output(wl_output))
+				&wl_output_interface, MIN(version, 4));
+		if (! create_output(wl_output, name))
 		{
 			loop = false;
 			ret = EXIT_FAILURE;
@@ -866,11 +3174,28 @@ static void registry_handle_global (void *data, struct wl_registry *registry,
 	}
 }
 
-static void noop () {}
+static void registry_handle_global_remove (void *data, struct wl_registry *registry,
+		uint32_t name)
+{
+	struct Output *output;
+	wl_list_for_each(output, &outputs, link)
+		if ( output->global_name == name )
+		{
+#ifndef FIXED_CONFIG
+			retain_layout_configs(output);
+#endif
+#if PERF_COUNTERS
+			if (perf_counters.enabled)
+				report_output_perf_stats(output);
+#endif
+			destroy_output(output);
+			return;
+		}
+}
 
 static const struct wl_registry_listener registry_listener = {
 	.global        = registry_handle_global,
-	.global_remove = noop
+	.global_remove = registry_handle_global_remove,
 };
 
 static void sync_handle_done (void *data, struct wl_callback *wl_callback,
@@ -884,13 +3209,7 @@ static void sync_handle_done (void *data, struct wl_callback *wl_callback,
 		fputs("Wayland compositor does not support river-layout-v3.\n", stderr);
 		ret = EXIT_FAILURE;
 		loop = false;
-		return;
 	}
-
-	struct Output *output;
-	wl_list_for_each(output, &outputs, link)
-		if (! output->configured)
-			configure_output(output);
 }
 
 static const struct wl_callback_listener sync_callback_listener = {
@@ -945,8 +3264,146 @@ static void finish_wayland (void)
 	wl_display_disconnect(wl_display);
 }
 
+static void handle_signal (int signum)
+{
+	const int saved_errno = errno;
+	const char byte = (char)signum;
+	if ( write(signal_pipe[1], &byte, 1) == -1 )
+	{
+		/* Nothing sensible to do in a signal handler. */
+	}
+	errno = saved_errno;
+}
+
+static bool init_signals (void)
+{
+	if ( pipe(signal_pipe) == -1 )
+	{
+		fprintf(stderr, "ERROR: pipe: %s\n", strerror(errno));
+		return false;
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+		fcntl(signal_pipe[i], F_SETFL, O_NONBLOCK);
+	}
+
+	struct sigaction action = { .sa_handler = handle_signal };
+	sigemptyset(&action.sa_mask);
+	if ( sigaction(SIGUSR2, &action, NULL) == -1 )
+	{
+		fprintf(stderr, "ERROR: sigaction: %s\n", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static void handle_signal_pipe (void)
+{
+	char byte;
+	while ( read(signal_pipe[0], &byte, 1) == 1 )
+		if ( byte == SIGUSR2 )
+		{
+#if FLIGHT_RECORDER
+			flight_recorder_dump();
+#endif
+#if PERF_COUNTERS
+			if (perf_counters.enabled)
+				report_perf_counters();
+#endif
+		}
+}
+
+/**
+ * Dispatches Wayland events until the loop is stopped. Unlike a plain
+ * wl_display_dispatch() loop, this also wakes up for signals and gives us a
+ * place to do work between dispatches.
+ */
+static void run_loop (void)
+{
+	struct pollfd fds[] = {
+		{ .fd = wl_display_get_fd(wl_display), .events = POLLIN },
+		{ .fd = signal_pipe[0],                .events = POLLIN },
+	};
+
+	while (loop)
+	{
+		while ( wl_display_prepare_read(wl_display) != 0 )
+		{
+			if ( wl_display_dispatch_pending(wl_display) == -1 )
+				return;
+		}
+
+		if ( wl_display_flush(wl_display) == -1 && errno != EAGAIN )
+		{
+			wl_display_cancel_read(wl_display);
+			return;
+		}
+
+		if ( poll(fds, 2, -1) == -1 )
+		{
+			wl_display_cancel_read(wl_display);
+			if ( errno == EINTR )
+				continue;
+			fprintf(stderr, "ERROR: poll: %s\n", strerror(errno));
+			return;
+		}
+
+		if ( fds[0].revents & POLLIN )
+		{
+			if ( wl_display_read_events(wl_display) == -1 )
+				return;
+		}
+		else
+			wl_display_cancel_read(wl_display);
+
+		if ( fds[0].revents & (POLLERR | POLLHUP) )
+			return;
+
+		if ( wl_display_dispatch_pending(wl_display) == -1 )
+			return;
+
+		if ( fds[1].revents & POLLIN )
+			handle_signal_pipe();
+
+#if FLIGHT_RECORDER
+		if (flight_recorder.dump_pending)
+			flight_recorder_dump();
+#endif
+	}
+}
+
+/** Prepares the layout configs given by the options for use. */
+static void init_layout_configs (void)
+{
+	if ( namespace_count == 0 )
+		namespaces[namespace_count++] = default_namespace;
+	for (uint32_t i = 0; i < namespace_count; i++)
+		update_layout_config(&namespaces[i].default_layout_config);
+#ifndef FIXED_CONFIG
+	for (uint32_t i = 0; i < namespace_count; i++)
+		namespaces[i].initial_layout_config = namespaces[i].default_layout_config;
+	for (uint32_t i = 0; i < preset_count; i++)
+		update_layout_config(&presets[i].config);
+	init_layout_config_pool();
+#endif
+}
+
+#ifndef FIXED_CONFIG
+static bool has_secondary_area (const struct Layout_config *config)
+{
+	if ( config->area_count < 2 )
+	{
+		fputs("ERROR: The layout has no secondary area.\n", stderr);
+		return false;
+	}
+	return true;
+}
+#endif
+
 int main (int argc, char *argv[])
 {
+#ifndef FIXED_CONFIG
 	enum
 	{
 		INNER_PADDING,
@@ -959,7 +3416,16 @@ int main (int argc, char *argv[])
 		SECONDARY_COUNT,
 		SECONDARY_SUBLAYOUT,
 		REMAINDER_SUBLAYOUT,
+		AREA,
 		PER_TAG_CONFIG,
+		NAMESPACE,
+		PRESET,
+		PLUGIN,
+		LATENCY_CRITICAL_OPTION,
+		PERF_COUNTERS_OPTION,
+		STATE_FILE_OPTION,
+		FLIGHT_RECORDER_FILE,
+		FLIGHT_RECORDER_THRESHOLD,
 	};
 
 	const struct option opts[] = {
@@ -974,11 +3440,23 @@ int main (int argc, char *argv[])
 		{ "secondary-count",     required_argument, NULL, SECONDARY_COUNT     },
 		{ "secondary-sublayout", required_argument, NULL, SECONDARY_SUBLAYOUT },
 		{ "remainder-sublayout", required_argument, NULL, REMAINDER_SUBLAYOUT },
+		{ "area",                required_argument, NULL, AREA                },
 		{ "per-tag-config",      no_argument,       NULL, PER_TAG_CONFIG      },
+		{ "namespace",           required_argument, NULL, NAMESPACE           },
+		{ "preset",              required_argument, NULL, PRESET              },
+		{ "plugin",              required_argument, NULL, PLUGIN              },
+		{ "latency-critical",    optional_argument, NULL, LATENCY_CRITICAL_OPTION },
+		{ "perf-counters",       no_argument,       NULL, PERF_COUNTERS_OPTION    },
+		{ "state-file",          required_argument, NULL, STATE_FILE_OPTION       },
+		{ "flight-recorder-file",      required_argument, NULL, FLIGHT_RECORDER_FILE      },
+		{ "flight-recorder-threshold", required_argument, NULL, FLIGHT_RECORDER_THRESHOLD },
 	};
 
 	int opt;
 	int32_t tmp;
+	struct Namespace *current = &default_namespace;
+	struct Layout_config *config = &current->default_layout_config;
+	const struct Layout_config *custom_areas = NULL;
 	while ( (opt = getopt_long(argc, argv, "h", opts, NULL)) != -1 ) switch (opt)
 	{
 		case 'h':
@@ -992,7 +3470,7 @@ int main (int argc, char *argv[])
 				fputs("ERROR: Inner padding may not be negative.\n", stderr);
 				return EXIT_FAILURE;
 			}
-			default_layout_config.inner_padding = (uint32_t)tmp;
+			config->inner_padding = (uint32_t)tmp;
 			break;
 
 		case OUTER_PADDING:
@@ -1002,7 +3480,7 @@ int main (int argc, char *argv[])
 				fputs("ERROR: Outer padding may not be negative.\n", stderr);
 				return EXIT_FAILURE;
 			}
-			default_layout_config.outer_padding = (uint32_t)tmp;
+			config->outer_padding = (uint32_t)tmp;
 			break;
 
 		case PRIMARY_COUNT:
@@ -1012,20 +3490,20 @@ int main (int argc, char *argv[])
 				fputs("ERROR: Main count may not be negative.\n", stderr);
 				return EXIT_FAILURE;
 			}
-			default_layout_config.primary_count = (uint32_t)tmp;
+			config->areas[0].count = (uint32_t)tmp;
 			break;
 
 		case PRIMARY_FACTOR:
-			default_layout_config.primary_ratio = CLAMP(atof(optarg), 0.1, 0.9);
+			config->areas[0].ratio = CLAMP(atof(optarg), 0.1, 0.9);
 			break;
 
 		case PRIMARY_SUBLAYOUT:
-			if (!sublayout_from_string(optarg, &default_layout_config.primary_sublayout))
+			if (!sublayout_from_string(optarg, &config->areas[0].sublayout))
 				return EXIT_FAILURE;
 			break;
 
 		case PRIMARY_POSITION:
-			if (!position_from_string(optarg, &default_layout_config.primary_position))
+			if (!position_from_string(optarg, &config->areas[0].position))
 				return EXIT_FAILURE;
 			break;
 
@@ -1036,38 +3514,144 @@ int main (int argc, char *argv[])
 				fputs("ERROR: Secondary count may not be negative.\n", stderr);
 				return EXIT_FAILURE;
 			}
-			default_layout_config.secondary_count = (uint32_t)tmp;
+			if (! has_secondary_area(config))
+				return EXIT_FAILURE;
+			config->areas[1].count = (uint32_t)tmp;
 			break;
 
 		case SECONDARY_FACTOR:
-			default_layout_config.secondary_ratio = CLAMP(atof(optarg), 0.1, 0.9);
+			if (! has_secondary_area(config))
+				return EXIT_FAILURE;
+			config->areas[1].ratio = CLAMP(atof(optarg), 0.1, 0.9);
 			break;
 
 		case SECONDARY_SUBLAYOUT:
-			if (!sublayout_from_string(optarg, &default_layout_config.secondary_sublayout))
+			if (! has_secondary_area(config))
+				return EXIT_FAILURE;
+			if (!sublayout_from_string(optarg, &config->areas[1].sublayout))
 				return EXIT_FAILURE;
 			break;
 
 		case REMAINDER_SUBLAYOUT:
-			if (!sublayout_from_string(optarg, &default_layout_config.remainder_sublayout))
+			if (!sublayout_from_string(optarg, &config->areas[config->area_count - 1].sublayout))
+				return EXIT_FAILURE;
+			break;
+
+		case AREA:
+			/* The first area given replaces the default areas. */
+			if ( custom_areas != config )
+			{
+				config->area_count = 0;
+				custom_areas = config;
+			}
+			if (! add_area_from_string(config, optarg))
 				return EXIT_FAILURE;
 			break;
 
 		case PER_TAG_CONFIG:
-			per_tag_config = true;
+			current->per_tag_config = true;
+			break;
+
+		case NAMESPACE:
+			if ( namespace_count == MAX_NAMESPACES )
+			{
+				fprintf(stderr, "ERROR: Too many namespaces. At most %d namespaces are supported.\n", MAX_NAMESPACES);
+				return EXIT_FAILURE;
+			}
+			current = &namespaces[namespace_count++];
+			*current = default_namespace;
+			current->name = optarg;
+			config = &current->default_layout_config;
+			break;
+
+		case PRESET:
+		{
+			char name[PRESET_NAME_SIZE];
+			if (! get_preset_name(name, optarg))
+				return EXIT_FAILURE;
+			struct Preset *preset = add_preset(name);
+			if ( preset == NULL )
+				return EXIT_FAILURE;
+			copy_layout_values(&preset->config, &default_namespace.default_layout_config);
+			config = &preset->config;
+			break;
+		}
+
+		case PLUGIN:
+			if (! load_plugin(optarg))
+				return EXIT_FAILURE;
+			break;
+
+		case LATENCY_CRITICAL_OPTION:
+			latency_critical.enabled = true;
+			if ( optarg == NULL )
+				break;
+			if (! strcmp(optarg, "fifo"))
+				latency_critical.policy = SCHED_FIFO;
+			else if (! strcmp(optarg, "rr"))
+				latency_critical.policy = SCHED_RR;
+			else
+			{
+				fprintf(stderr, "ERROR: Unknown scheduling policy: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case PERF_COUNTERS_OPTION:
+			perf_counters.enabled = true;
+			break;
+
+		case STATE_FILE_OPTION:
+			state_path = optarg;
+			break;
+
+		case FLIGHT_RECORDER_FILE:
+			flight_recorder.path = optarg;
+			break;
+
+		case FLIGHT_RECORDER_THRESHOLD:
+			tmp = atoi(optarg);
+			if ( tmp < 0 )
+			{
+				fputs("ERROR: Flight recorder threshold may not be negative.\n", stderr);
+				return EXIT_FAILURE;
+			}
+			flight_recorder.threshold = (uint64_t)tmp * 1000;
 			break;
 
 		default:
 			return EXIT_FAILURE;
 
 	}
-
-	if (init_wayland())
+#else
+	if (! check_fixed_config(&default_namespace.default_layout_config))
+		return EXIT_FAILURE;
+#endif
+
+	init_layout_configs();
+#if LATENCY_CRITICAL
+	if (latency_critical.enabled)
+		init_latency_critical();
+#endif
+#if PERF_COUNTERS
+	if (perf_counters.enabled)
+		init_perf_counters();
+#endif
+
+	if ( init_signals() && init_state_file() && init_wayland() )
 	{
 		ret = EXIT_SUCCESS;
-		while ( loop && wl_display_dispatch(wl_display) != -1 );
+		run_loop();
 	}
+#if PERF_COUNTERS
+	if (perf_counters.enabled)
+		report_perf_counters();
+#endif
 	finish_wayland();
+#if PERF_COUNTERS
+	finish_perf_counters();
+#endif
+	finish_state_file();
 	return ret;
 }
 
@@ -0,0 +1,130 @@
+/*
+ * Fails if a layout demand allocates or frees memory once the view buffers of
+ * the output have room for the demanded amount of views.
+ *
+ * The allocation functions are wrapped with --wrap, see the Makefile, so only
+ * calls made by stacktile itself are counted.
+ */
+
+#define main stacktile_main
+#include "../stacktile.c"
+#undef main
+
+#include "mock-wayland.h"
+
+/* Amount of views the buffers are grown to before counting. */
+#define WARM_VIEW_COUNT 512
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t count, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+void __real_free (void *ptr);
+
+static bool counting;
+static unsigned long allocations;
+
+void *__wrap_malloc (size_t size)
+{
+	if (counting)
+		allocations++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc (size_t count, size_t size)
+{
+	if (counting)
+		allocations++;
+	return __real_calloc(count, size);
+}
+
+void *__wrap_realloc (void *ptr, size_t size)
+{
+	if (counting)
+		allocations++;
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free (void *ptr)
+{
+	if (counting)
+		allocations++;
+	__real_free(ptr);
+}
+
+static const char *commands[] = {
+	"primary_count +1",
+	"secondary_count 3",
+	"primary_ratio -0.05",
+	"remainder_sublayout grid",
+	"primary_sublayout full",
+	"primary_position right",
+	"all_primary true",
+	"all_primary false",
+	"inner_padding 0",
+	"outer_padding 40",
+	"all_tags inner_padding +2",
+	"all_outputs secondary_sublayout columns",
+	"default primary_count 2",
+	"save_preset alloc",
+	"preset alloc",
+	"reset",
+};
+
+static uint32_t next_random (uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static bool demand (struct Layout *layout, uint32_t view_count, uint32_t width,
+		uint32_t height, uint32_t tags, uint32_t serial)
+{
+	allocations = 0;
+	counting = true;
+	mock_layout_demand(layout->river_layout, view_count, width, height, tags, serial);
+	counting = false;
+	if ( allocations == 0 )
+		return true;
+	fprintf(stderr, "FAIL: %lu allocations in layout demand: %u views, %ux%u, tags 0x%x, config \"%s\"\n",
+			allocations, view_count, width, height, tags, mock_layout_name);
+	return false;
+}
+
+int main (void)
+{
+	default_namespace.per_tag_config = true;
+	init_layout_configs();
+	wl_list_init(&outputs);
+	layout_manager = (struct river_layout_manager_v3 *)mock_proxy_create(
+			&river_layout_manager_v3_interface);
+	for (uint32_t i = 1; i <= 2; i++)
+		if (! create_output((struct wl_output *)mock_proxy_create(&wl_output_interface), i))
+			return EXIT_FAILURE;
+
+	/* Grow every view buffer, one cache slot per tag set. */
+	struct Output *output;
+	wl_list_for_each(output, &outputs, link)
+		for (uint32_t tags = 1; tags <= 1 << LAYOUT_CACHE_SIZE; tags <<= 1)
+			mock_layout_demand(output->layouts[0].river_layout, WARM_VIEW_COUNT,
+					1920, 1080, tags, 0);
+
+	uint32_t state = 0x2545f491;
+	for (uint32_t serial = 1; serial <= 20000; serial++)
+	{
+		wl_list_for_each(output, &outputs, link)
+		{
+			struct Layout *layout = &output->layouts[0];
+			if ( next_random(&state) % 4 == 0 )
+				mock_user_command(layout->river_layout,
+						commands[next_random(&state) % (sizeof(commands) / sizeof(commands[0]))]);
+			if (! demand(layout, next_random(&state) % (WARM_VIEW_COUNT + 1),
+						1 + next_random(&state) % 3840, 1 + next_random(&state) % 2160,
+						1u << (next_random(&state) % 8), serial))
+				return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
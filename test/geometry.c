@@ -0,0 +1,166 @@
+/*
+ * Fails if any view of a layout demand is empty or lies outside of the
+ * output. Every combination of sublayouts is tried on small outputs, with
+ * large amounts of views and with padding far larger than the output, and so
+ * are a few nested area trees. Nested areas must also cover all of the space
+ * of their parent.
+ */
+
+#define main stacktile_main
+#include "../stacktile.c"
+#undef main
+
+#include "mock-wayland.h"
+
+#define MAX_SMALL_SIZE 24
+#define MAX_SMALL_COUNT 10
+
+static const uint32_t paddings[][2] = {
+	{ 0, 0 },
+	{ 1, 1 },
+	{ 3, 0 },
+	{ 0, 3 },
+	{ 0, INT32_MAX },
+	{ INT32_MAX, 0 },
+	{ INT32_MAX, INT32_MAX },
+};
+
+/* Area trees in the format of --area. */
+static const char *trees[][MAX_AREAS + 1] = {
+	{ "0:0.5:left:rows", "1:0.5:top:rows:1", "1:0.5:top:rows:1", "0:0.5:auto:columns" },
+	{ "0:0.6:left:rows", "2:0.3:top:grid:1", "0:0.5:auto:rows:1", "1:0.5:auto:full:3",
+		"0:0.2:auto:stack:3", "1:0.5:right:columns:1", "0:0.5:auto:rows" },
+	{ "0:0.5:top:rows", "0:0.5:left:rows:1", "1:0.5:top:rows:2", "1:0.5:top:rows:2",
+		"3:0.5:auto:columns:1", "0:0.5:auto:stack" },
+};
+
+static const uint32_t large_sizes[] = { 0, 1, 2, 5, 24 };
+static const uint32_t large_counts[] = { 100, 1000 };
+
+static unsigned long demands;
+static unsigned long failures;
+
+static void check_demand (struct Layout *layout, uint32_t view_count,
+		uint32_t width, uint32_t height)
+{
+	demands++;
+	const uint32_t commits = mock_commit_count;
+	mock_layout_demand(layout->river_layout, view_count, width, height, 1, (uint32_t)demands);
+
+	if ( mock_view_count != view_count || mock_commit_count != commits + 1 )
+	{
+		fprintf(stderr, "FAIL: \"%s\" on %ux%u: %u of %u views, %u commits\n",
+				mock_layout_name, width, height, mock_view_count, view_count,
+				mock_commit_count - commits);
+		failures++;
+		return;
+	}
+
+	for (uint32_t i = 0; i < view_count; i++)
+	{
+		const struct mock_view *view = &mock_views[i];
+		const bool empty = view->width == 0 || view->height == 0;
+
+		/* On an output without any area, views can only be kept at its
+		 * origin.
+		 */
+		const bool outside = view->x < 0 || view->y < 0
+			|| ( width > 0 && (uint64_t)view->x + view->width > width )
+			|| ( height > 0 && (uint64_t)view->y + view->height > height );
+		if ( empty || outside )
+		{
+			fprintf(stderr, "FAIL: \"%s\" on %ux%u, padding %u/%u, %u views: view %u is %d,%d %ux%u\n",
+					mock_layout_name, width, height,
+					namespaces[0].default_layout_config.inner_padding,
+					namespaces[0].default_layout_config.outer_padding,
+					view_count, i, view->x, view->y, view->width, view->height);
+			failures++;
+			return;
+		}
+	}
+}
+
+/**
+ * Fails if the views of the first tree, which do not overlap, do not cover
+ * the output without padding.
+ */
+static void check_coverage (struct Layout *layout)
+{
+	mock_layout_demand(layout->river_layout, 3, 1000, 1000, 1, 0);
+	uint64_t covered = 0;
+	for (uint32_t i = 0; i < mock_view_count; i++)
+		covered += (uint64_t)mock_views[i].width * mock_views[i].height;
+	if ( covered != 1000 * 1000 )
+	{
+		fprintf(stderr, "FAIL: \"%s\" on 1000x1000, 3 views: %lu of 1000000 pixels covered\n",
+				mock_layout_name, (unsigned long)covered);
+		failures++;
+	}
+}
+
+static void check_config (struct Layout *layout)
+{
+	for (uint32_t width = 0; width <= MAX_SMALL_SIZE; width++)
+		for (uint32_t height = 0; height <= MAX_SMALL_SIZE; height++)
+			for (uint32_t count = 0; count <= MAX_SMALL_COUNT; count++)
+				check_demand(layout, count, width, height);
+
+	for (size_t i = 0; i < sizeof(large_sizes) / sizeof(large_sizes[0]); i++)
+		for (size_t j = 0; j < sizeof(large_sizes) / sizeof(large_sizes[0]); j++)
+			for (size_t k = 0; k < sizeof(large_counts) / sizeof(large_counts[0]); k++)
+				check_demand(layout, large_counts[k], large_sizes[i], large_sizes[j]);
+}
+
+int main (void)
+{
+	init_layout_configs();
+	wl_list_init(&outputs);
+	layout_manager = (struct river_layout_manager_v3 *)mock_proxy_create(
+			&river_layout_manager_v3_interface);
+	if (! create_output((struct wl_output *)mock_proxy_create(&wl_output_interface), 1))
+		return EXIT_FAILURE;
+	struct Output *output = wl_container_of(outputs.next, output, link);
+	struct Layout *layout = &output->layouts[0];
+	struct Layout_config *config = &namespaces[0].default_layout_config;
+
+	for (size_t p = 0; p < sizeof(paddings) / sizeof(paddings[0]); p++)
+		for (uint32_t primary = 0; primary < FIRST_PLUGIN_SUBLAYOUT; primary++)
+			for (uint32_t secondary = 0; secondary < FIRST_PLUGIN_SUBLAYOUT; secondary++)
+				for (uint32_t remainder = 0; remainder < FIRST_PLUGIN_SUBLAYOUT; remainder++)
+					for (int all_primary = 0; all_primary < 2; all_primary++)
+					{
+						config->inner_padding        = paddings[p][0];
+						config->outer_padding        = paddings[p][1];
+						config->areas[0].sublayout   = (enum Sublayout)primary;
+						config->areas[1].sublayout   = (enum Sublayout)secondary;
+						config->areas[2].sublayout   = (enum Sublayout)remainder;
+						config->all_primary          = all_primary;
+						update_layout_config(config);
+						check_config(layout);
+					}
+
+	for (size_t t = 0; t < sizeof(trees) / sizeof(trees[0]); t++)
+	{
+		config->area_count  = 0;
+		config->all_primary = false;
+		for (size_t i = 0; trees[t][i] != NULL; i++)
+			if (! add_area_from_string(config, trees[t][i]))
+				return EXIT_FAILURE;
+		for (size_t p = 0; p < sizeof(paddings) / sizeof(paddings[0]); p++)
+		{
+			config->inner_padding = paddings[p][0];
+			config->outer_padding = paddings[p][1];
+			update_layout_config(config);
+			check_config(layout);
+			if ( t == 0 && paddings[p][0] == 0 && paddings[p][1] == 0 )
+				check_coverage(layout);
+		}
+	}
+
+	if ( failures > 0 )
+	{
+		fprintf(stderr, "FAIL: %lu of %lu layout demands\n", failures, demands);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
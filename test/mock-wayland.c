@@ -0,0 +1,133 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mock-wayland.h"
+
+struct Mock_proxy
+{
+	const struct wl_interface *interface;
+	void (**listener)(void);
+	void *data;
+};
+
+struct mock_view mock_views[MOCK_MAX_VIEWS];
+uint32_t mock_view_count;
+uint32_t mock_commit_count;
+uint32_t mock_commit_serial;
+char mock_layout_name[256];
+
+struct wl_proxy *mock_proxy_create (const struct wl_interface *interface)
+{
+	struct Mock_proxy *proxy = calloc(1, sizeof(struct Mock_proxy));
+	if ( proxy == NULL )
+	{
+		fputs("Failed to allocate.\n", stderr);
+		abort();
+	}
+	proxy->interface = interface;
+	return (struct wl_proxy *)proxy;
+}
+
+void *mock_proxy_get_data (struct wl_proxy *proxy)
+{
+	return ((struct Mock_proxy *)proxy)->data;
+}
+
+static void record_request (struct Mock_proxy *proxy, uint32_t opcode, va_list args)
+{
+	if ( proxy->interface != &river_layout_v3_interface )
+		return;
+
+	if ( opcode == 1 ) /* push_view_dimensions */
+	{
+		struct mock_view view;
+		view.x      = va_arg(args, int32_t);
+		view.y      = va_arg(args, int32_t);
+		view.width  = va_arg(args, uint32_t);
+		view.height = va_arg(args, uint32_t);
+		if ( mock_view_count < MOCK_MAX_VIEWS )
+			mock_views[mock_view_count] = view;
+		mock_view_count++;
+	}
+	else if ( opcode == 2 ) /* commit */
+	{
+		const char *name = va_arg(args, const char *);
+		snprintf(mock_layout_name, sizeof(mock_layout_name), "%s", name);
+		mock_commit_serial = va_arg(args, uint32_t);
+		mock_commit_count++;
+	}
+}
+
+struct wl_proxy *wl_proxy_marshal_flags (struct wl_proxy *proxy, uint32_t opcode,
+		const struct wl_interface *interface, uint32_t version, uint32_t flags, ...)
+{
+	struct Mock_proxy *mock = (struct Mock_proxy *)proxy;
+
+	va_list args;
+	va_start(args, flags);
+	record_request(mock, opcode, args);
+	va_end(args);
+
+	if ( flags & WL_MARSHAL_FLAG_DESTROY )
+		free(mock);
+
+	/* Requests creating an object pass its interface. */
+	return interface != NULL ? mock_proxy_create(interface) : NULL;
+}
+
+void wl_proxy_destroy (struct wl_proxy *proxy)
+{
+	free(proxy);
+}
+
+int wl_proxy_add_listener (struct wl_proxy *proxy, void (**implementation)(void), void *data)
+{
+	struct Mock_proxy *mock = (struct Mock_proxy *)proxy;
+	mock->listener = implementation;
+	mock->data     = data;
+	return 0;
+}
+
+uint32_t wl_proxy_get_version (struct wl_proxy *proxy)
+{
+	return 1;
+}
+
+int wl_display_flush (struct wl_display *display)
+{
+	return 0;
+}
+
+void mock_layout_demand (struct river_layout_v3 *river_layout, uint32_t view_count,
+		uint32_t width, uint32_t height, uint32_t tags, uint32_t serial)
+{
+	struct Mock_proxy *proxy = (struct Mock_proxy *)river_layout;
+	const struct river_layout_v3_listener *listener =
+		(const struct river_layout_v3_listener *)proxy->listener;
+	mock_view_count = 0;
+	listener->layout_demand(proxy->data, river_layout, view_count, width, height, tags, serial);
+}
+
+void mock_user_command (struct river_layout_v3 *river_layout, const char *command)
+{
+	struct Mock_proxy *proxy = (struct Mock_proxy *)river_layout;
+	const struct river_layout_v3_listener *listener =
+		(const struct river_layout_v3_listener *)proxy->listener;
+	listener->user_command(proxy->data, river_layout, command);
+}
+
+void mock_output_name (struct wl_output *output, const char *name)
+{
+	struct Mock_proxy *proxy = (struct Mock_proxy *)output;
+	const struct wl_output_listener *listener = (const struct wl_output_listener *)proxy->listener;
+	listener->name(proxy->data, output, name);
+}
+
+void mock_output_done (struct wl_output *output)
+{
+	struct Mock_proxy *proxy = (struct Mock_proxy *)output;
+	const struct wl_output_listener *listener = (const struct wl_output_listener *)proxy->listener;
+	listener->done(proxy->data, output);
+}
@@ -0,0 +1,48 @@
+#ifndef MOCK_WAYLAND_H
+#define MOCK_WAYLAND_H
+
+/*
+ * Stand-in for the compositor used by the tests, benchmarks and fuzzers.
+ *
+ * The proxy functions of libwayland-client are replaced, so no connection is
+ * needed: proxies are plain allocations, requests are recorded instead of
+ * being sent and events are delivered to the listeners by calling the mock_*
+ * functions below.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wayland-client.h>
+
+#include "../river-layout-v3.h"
+
+/* Upper bound on the amount of view dimensions recorded per layout demand. */
+#define MOCK_MAX_VIEWS 65536
+
+struct mock_view
+{
+	int32_t x, y;
+	uint32_t width, height;
+};
+
+/* Requests of the last layout demand delivered with mock_layout_demand(). */
+extern struct mock_view mock_views[MOCK_MAX_VIEWS];
+extern uint32_t mock_view_count;
+extern uint32_t mock_commit_count;
+extern uint32_t mock_commit_serial;
+extern char mock_layout_name[256];
+
+struct wl_proxy *mock_proxy_create (const struct wl_interface *interface);
+
+/** Returns the data of the listener of the proxy. */
+void *mock_proxy_get_data (struct wl_proxy *proxy);
+
+void mock_layout_demand (struct river_layout_v3 *river_layout, uint32_t view_count,
+		uint32_t width, uint32_t height, uint32_t tags, uint32_t serial);
+void mock_user_command (struct river_layout_v3 *river_layout, const char *command);
+
+void mock_output_name (struct wl_output *output, const char *name);
+void mock_output_done (struct wl_output *output);
+
+#endif